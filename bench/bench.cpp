@@ -0,0 +1,331 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "corpus.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "thread_pool.hpp"
+#include "vm.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Every allocation in the process goes through here so each benchmark can
+// report how many it made. The counters are atomic because the parallel lexer
+// allocates on worker threads.
+namespace {
+std::atomic<uint64_t> allocationCount(0);
+std::atomic<uint64_t> allocationBytes(0);
+}
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+
+struct BenchOptions {
+    CorpusShape shape;
+    double megabytes = 8;
+    uint64_t seed = 1;
+    unsigned iterations = 5;
+    bool json = false;
+    std::string corpusPath; // Where to save the corpus, if anywhere
+};
+
+struct Result {
+    std::string name;
+    double seconds;       // Fastest iteration
+    uint64_t allocations; // In that iteration
+    uint64_t allocatedBytes;
+    uint64_t cycles;
+};
+
+// Time stamp counter ticks where there is one, which track core cycles closely
+// enough on anything recent; 0 elsewhere
+uint64_t cycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+bool haveCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Runs body the given number of times and keeps the fastest run
+Result measure(const std::string &name, unsigned iterations, const std::function<void()> &body) {
+    Result best = {name, 0, 0, 0, 0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t count = allocationCount.load();
+        uint64_t bytes = allocationBytes.load();
+        uint64_t cycles = cycleCounter();
+        auto start = std::chrono::steady_clock::now();
+
+        body();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < best.seconds) {
+            best.seconds = seconds;
+            best.cycles = cycleCounter() - cycles;
+            best.allocations = allocationCount.load() - count;
+            best.allocatedBytes = allocationBytes.load() - bytes;
+        }
+    }
+    return best;
+}
+
+// A fixed program for the VM: loops, calls, int and float arithmetic. The
+// generated corpus is for the front end only and would not run.
+const char *const vmWorkload = R"(
+fun step(int x) { return x * 3 + 1; }
+int total = 0;
+int i = 0;
+while (i < 2000000) {
+    if (i / 2 * 2 == i) { total = total + step(i); } else { total = total - i; }
+    i = i + 1;
+}
+float f = 0.5;
+for (int j = 0; j < 500000; j = j + 1) { f = f * 0.5 + 0.25; }
+output(total);
+output(f);
+)";
+
+struct VmResult {
+    Result run;
+    uint64_t instructions; // Per run
+};
+
+// Compiles the workload once and times running it
+VmResult measureVm(unsigned iterations) {
+    SymbolTable symbols;
+    TokenBuffer tokens = tokenize(vmWorkload, symbols);
+    Parser parser(tokens);
+    parser.parse();
+    Bytecode program;
+    Diagnostics errors;
+    compileProgram(parser.ast(), symbols, tokens.lineIndex(), program, errors);
+    if (!parser.diagnostics().empty() || !errors.empty()) {
+        std::cerr << "Error: the VM workload does not compile" << std::endl;
+        std::exit(1);
+    }
+
+    uint64_t instructions = 0;
+    Result run = measure("vm_run", iterations, [&] {
+        std::ostringstream out;
+        VM vm(program, out);
+        vm.run();
+        instructions = vm.instructionCount();
+    });
+    return {run, instructions};
+}
+
+bool parseOptions(int argc, char const *argv[], BenchOptions &options) {
+    findCorpusShape("mixed", options.shape);
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument.compare(0, 8, "--shape=") == 0) {
+            if (!findCorpusShape(argument.substr(8), options.shape)) {
+                std::cerr << "Error: Unknown shape " << argument.substr(8) << ", expected one of "
+                          << corpusShapeNames() << std::endl;
+                return false;
+            }
+        } else if (argument.compare(0, 7, "--size=") == 0) {
+            options.megabytes = std::strtod(argument.c_str() + 7, nullptr);
+        } else if (argument.compare(0, 7, "--seed=") == 0) {
+            options.seed = std::strtoull(argument.c_str() + 7, nullptr, 10);
+        } else if (argument.compare(0, 13, "--iterations=") == 0) {
+            options.iterations = std::strtoul(argument.c_str() + 13, nullptr, 10);
+        } else if (argument == "--json") {
+            options.json = true;
+        } else if (argument.compare(0, 15, "--write-corpus=") == 0) {
+            options.corpusPath = argument.substr(15);
+        } else {
+            std::cerr << "Usage: myn_bench [--shape=NAME] [--size=MB] [--seed=N] [--iterations=N] [--json]"
+                      << " [--write-corpus=PATH]" << std::endl
+                      << "Shapes: " << corpusShapeNames() << std::endl;
+            return false;
+        }
+    }
+
+    if (options.megabytes <= 0 || options.iterations == 0) {
+        std::cerr << "Error: --size and --iterations must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void printText(const BenchOptions &options, size_t bytes, size_t tokens, const std::vector<Result> &results) {
+    std::printf("corpus: %s, seed %llu, %.2f MB, %zu tokens, best of %u\n", options.shape.name,
+                static_cast<unsigned long long>(options.seed), bytes / 1e6, tokens, options.iterations);
+    std::printf("%-18s %10s %12s %10s %12s %13s\n", "benchmark", "MB/s", "Mtokens/s", "allocs", "alloc MB",
+                "cycles/token");
+    for (const Result &result : results) {
+        std::printf("%-18s %10.1f %12.2f %10llu %12.2f", result.name.c_str(), bytes / 1e6 / result.seconds,
+                    tokens / 1e6 / result.seconds, static_cast<unsigned long long>(result.allocations),
+                    result.allocatedBytes / 1e6);
+        if (haveCycleCounter()) {
+            std::printf(" %13.1f\n", static_cast<double>(result.cycles) / tokens);
+        } else {
+            std::printf(" %13s\n", "-");
+        }
+    }
+}
+
+void printVmText(const VmResult &vm) {
+    std::printf("\nvm: %llu instructions a run\n", static_cast<unsigned long long>(vm.instructions));
+    std::printf("%-18s %10s %12s %10s %12s %13s\n", "benchmark", "seconds", "Minstr/s", "allocs", "alloc MB",
+                "cycles/instr");
+    std::printf("%-18s %10.4f %12.1f %10llu %12.2f", vm.run.name.c_str(), vm.run.seconds,
+                vm.instructions / 1e6 / vm.run.seconds, static_cast<unsigned long long>(vm.run.allocations),
+                vm.run.allocatedBytes / 1e6);
+    if (haveCycleCounter()) {
+        std::printf(" %13.2f\n", static_cast<double>(vm.run.cycles) / vm.instructions);
+    } else {
+        std::printf(" %13s\n", "-");
+    }
+}
+
+void printJson(const BenchOptions &options, size_t bytes, size_t tokens, const std::vector<Result> &results,
+               const VmResult &vm) {
+    std::printf("{\n");
+    std::printf("  \"corpus\": {\"shape\": \"%s\", \"seed\": %llu, \"bytes\": %zu, \"tokens\": %zu},\n",
+                options.shape.name, static_cast<unsigned long long>(options.seed), bytes, tokens);
+    std::printf("  \"iterations\": %u,\n", options.iterations);
+    std::printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        std::printf("    {\"name\": \"%s\", \"seconds\": %.6f, \"mb_per_s\": %.3f, \"tokens_per_s\": %.0f, "
+                    "\"allocations\": %llu, \"allocated_bytes\": %llu, \"cycles_per_token\": ",
+                    result.name.c_str(), result.seconds, bytes / 1e6 / result.seconds, tokens / result.seconds,
+                    static_cast<unsigned long long>(result.allocations),
+                    static_cast<unsigned long long>(result.allocatedBytes));
+        if (haveCycleCounter()) {
+            std::printf("%.3f}", static_cast<double>(result.cycles) / tokens);
+        } else {
+            std::printf("null}");
+        }
+        std::printf(i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::printf("  ],\n");
+    std::printf("  \"vm\": {\"name\": \"%s\", \"instructions\": %llu, \"seconds\": %.6f, "
+                "\"instructions_per_s\": %.0f, \"allocations\": %llu, \"cycles_per_instruction\": ",
+                vm.run.name.c_str(), static_cast<unsigned long long>(vm.instructions), vm.run.seconds,
+                vm.instructions / vm.run.seconds, static_cast<unsigned long long>(vm.run.allocations));
+    if (haveCycleCounter()) {
+        std::printf("%.3f}\n", static_cast<double>(vm.run.cycles) / vm.instructions);
+    } else {
+        std::printf("null}\n");
+    }
+    std::printf("}\n");
+}
+
+} // namespace
+
+int main(int argc, char const *argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+#ifndef __OPTIMIZE__
+    std::cerr << "Warning: myn_bench was built without optimization, configure with "
+              << "-DCMAKE_BUILD_TYPE=Release for meaningful numbers" << std::endl;
+#endif
+
+    const std::string corpus =
+        generateCorpus(options.shape, static_cast<size_t>(options.megabytes * 1e6), options.seed);
+    if (!options.corpusPath.empty()) {
+        std::ofstream file(options.corpusPath, std::ios::binary);
+        file << corpus;
+        if (!file) {
+            std::cerr << "Error: Could not write " << options.corpusPath << std::endl;
+            return 1;
+        }
+    }
+
+    // Lexed once up front for the parser benchmark and the token count
+    SymbolTable symbols;
+    const TokenBuffer tokens = tokenize(corpus, symbols);
+
+    std::vector<Result> results;
+    results.push_back(measure("tokenize", options.iterations, [&] {
+        SymbolTable fresh;
+        tokenize(corpus, fresh);
+    }));
+    results.push_back(measure("tokenize_parallel", options.iterations, [&] {
+        SymbolTable fresh;
+        tokenizeParallel(corpus, fresh, sharedThreadPool());
+    }));
+    results.push_back(measure("parse", options.iterations, [&] {
+        Parser parser(tokens);
+        parser.parse();
+    }));
+    results.push_back(measure("parse_parallel", options.iterations, [&] {
+        Parser parser(tokens);
+        parser.parseParallel(sharedThreadPool());
+    }));
+    results.push_back(measure("parse_lazy", options.iterations, [&] {
+        Parser parser(tokens);
+        parser.setLazyBodies(true);
+        parser.parse();
+    }));
+    results.push_back(measure("lex_and_parse", options.iterations, [&] {
+        SymbolTable fresh;
+        Lexer lexer(corpus, fresh);
+        TokenStream stream(lexer);
+        Parser parser(stream);
+        parser.parse();
+    }));
+
+    VmResult vm = measureVm(options.iterations);
+
+    if (options.json) {
+        printJson(options, corpus.size(), tokens.size(), results, vm);
+    } else {
+        printText(options, corpus.size(), tokens.size(), results);
+        printVmText(vm);
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include "corpus.hpp"
+#include <vector>
+
+namespace {
+
+const CorpusShape shapes[] = {
+    // name, maxDepth, stringLength, identifiers, commentPercent
+    {"mixed", 4, 24, 2000, 10},
+    {"nesting", 64, 8, 200, 2},
+    {"strings", 2, 400, 200, 2},
+    {"identifiers", 3, 8, 200000, 2},
+    {"comments", 3, 16, 1000, 60},
+};
+
+// splitmix64. The standard engines are reproducible but the distributions
+// are not, so the corpus would differ between standard libraries.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform enough in [0, n) for the small n used here
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>(next() % n); }
+    bool percent(unsigned p) { return below(100) < p; }
+
+private:
+    uint64_t state;
+};
+
+// Names are spelled from syllables, which never form a keyword
+std::string makeName(uint32_t index) {
+    static const char *const syllables[] = {"ka", "lo", "mi", "nu", "re", "sa", "ti", "vo",
+                                            "ze", "bu", "di", "go", "ha", "ju", "pe", "wy"};
+    std::string name;
+    do {
+        name += syllables[index % 16];
+        index /= 16;
+    } while (index != 0 || name.size() < 4);
+    return name;
+}
+
+class Generator {
+public:
+    Generator(const CorpusShape &shape, uint64_t seed) : shape(shape), random(seed) {
+        names.reserve(shape.identifiers);
+        for (uint32_t i = 0; i < shape.identifiers; ++i) {
+            names.push_back(makeName(i));
+        }
+    }
+
+    std::string run(size_t size) {
+        out.reserve(size + 4096);
+        while (out.size() < size) {
+            function();
+        }
+        return std::move(out);
+    }
+
+private:
+    const CorpusShape &shape;
+    Random random;
+    std::vector<std::string> names;
+    std::string out;
+
+    const std::string &name() { return names[random.below(static_cast<uint32_t>(names.size()))]; }
+
+    void indent(unsigned depth) { out.append(depth * 4, ' '); }
+
+    void function() {
+        static const char *const types[] = {"int", "float", "string", "bool"};
+
+        out += "fun ";
+        out += name();
+        out += '(';
+        for (unsigned i = 0, count = random.below(4); i < count; ++i) {
+            out += i == 0 ? "" : ", ";
+            out += types[random.below(4)];
+            out += ' ';
+            out += name();
+        }
+        out += ") {\n";
+        body(1, 1 + random.below(shape.maxDepth));
+        out += "}\n\n";
+    }
+
+    // A few statements, one of which opens the next level down
+    void body(unsigned depth, unsigned maxDepth) {
+        unsigned count = 2 + random.below(5);
+        unsigned nested = depth < maxDepth ? random.below(count) : count;
+        for (unsigned i = 0; i < count; ++i) {
+            if (i == nested) {
+                whileLoop(depth, maxDepth);
+            } else {
+                statement(depth);
+            }
+        }
+    }
+
+    void whileLoop(unsigned depth, unsigned maxDepth) {
+        indent(depth);
+        out += "while (";
+        expression();
+        out += ") {\n";
+        body(depth + 1, maxDepth);
+        indent(depth);
+        out += "}\n";
+    }
+
+    void statement(unsigned depth) {
+        if (random.percent(shape.commentPercent)) {
+            comment(depth);
+            return;
+        }
+
+        indent(depth);
+        if (random.percent(30)) {
+            out += "output(";
+            string();
+            out += ");\n";
+        } else {
+            out += name();
+            out += '(';
+            for (unsigned i = 0, count = random.below(4); i < count; ++i) {
+                out += i == 0 ? "" : ", ";
+                expression();
+            }
+            out += ");\n";
+        }
+    }
+
+    void expression() {
+        static const char operators[] = {'+', '-', '*', '/'};
+
+        operand();
+        for (unsigned i = 0, count = random.below(3); i < count; ++i) {
+            out += ' ';
+            out += operators[random.below(4)];
+            out += ' ';
+            operand();
+        }
+    }
+
+    void operand() {
+        switch (random.below(4)) {
+        case 0:
+            out += std::to_string(random.below(100000));
+            break;
+        case 1:
+            out += std::to_string(random.below(1000));
+            out += '.';
+            out += std::to_string(random.below(100));
+            break;
+        default:
+            out += name();
+            break;
+        }
+    }
+
+    void string() {
+        out += '\'';
+        words(shape.stringLength / 2 + random.below(shape.stringLength + 1));
+        out += '\'';
+    }
+
+    void comment(unsigned depth) {
+        indent(depth);
+        if (random.percent(70)) {
+            out += "# ";
+            words(10 + random.below(60));
+            out += '\n';
+        } else {
+            out += "/* ";
+            words(20 + random.below(120));
+            out += " */\n";
+        }
+    }
+
+    // Filler text of about length bytes that is safe inside strings and comments
+    void words(size_t length) {
+        if (length == 0) {
+            return;
+        }
+        size_t end = out.size() + length;
+        while (out.size() < end) {
+            out += names[random.below(static_cast<uint32_t>(names.size()))];
+            out += ' ';
+        }
+        out.pop_back();
+    }
+};
+
+} // namespace
+
+bool findCorpusShape(std::string_view name, CorpusShape &shape) {
+    for (const CorpusShape &candidate : shapes) {
+        if (name == candidate.name) {
+            shape = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string corpusShapeNames() {
+    std::string list;
+    for (const CorpusShape &shape : shapes) {
+        list += list.empty() ? "" : ", ";
+        list += shape.name;
+    }
+    return list;
+}
+
+std::string generateCorpus(const CorpusShape &shape, size_t size, uint64_t seed) {
+    return Generator(shape, seed).run(size);
+}
@@ -0,0 +1,27 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// What a generated Myn program leans towards. Every shape produces programs
+// that the lexer and parser accept, so both can be timed on the same input.
+struct CorpusShape {
+    const char *name;
+    unsigned maxDepth;       // Deepest nesting of while blocks in a function
+    unsigned stringLength;   // Average length of a string literal
+    unsigned identifiers;    // Distinct names to draw from
+    unsigned commentPercent; // Share of statements that are comments
+};
+
+// Looks up one of the presets: mixed, nesting, strings, identifiers, comments
+bool findCorpusShape(std::string_view name, CorpusShape &shape);
+// The preset names separated by commas, for usage messages
+std::string corpusShapeNames();
+
+// About size bytes of Myn source, always the same for a shape, size and seed
+std::string generateCorpus(const CorpusShape &shape, size_t size, uint64_t seed);
+
+#endif // CORPUS_H
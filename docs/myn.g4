@@ -2,7 +2,10 @@ grammar myn;
 
 program: declaration*;
 
-declaration: function_declaration | class_declaration;
+declaration: import_declaration | function_declaration | class_declaration;
+
+// Brings in the top-level declarations of the module compiled from name.myn
+import_declaration: 'import' identifier ';';
 
 function_declaration: 'fun' identifier '(' parameters? ')' '{' statement* '}';
 
@@ -49,13 +52,16 @@ primary_expression: assignment
                   | function_call
                   | literal
                   | identifier
-                  | array;
+                  | array
+                  | '(' expression ')';
 
 assignment: identifier '=' expression;
 
 function_call: identifier '(' arguments? ')';
 arguments: expression (',' expression)*;
 
+// Left-associative, from loosest to tightest: '||', '&&', '==' '!=',
+// '<' '>' '<=' '>=', '+' '-', '*' '/'
 binary_operator: '+' | '-' | '*' | '/' | '==' | '!=' | '<' | '>' | '<=' | '>=' | '&&' | '||';
 
 type: 'int' | 'float' | 'string' | 'bool' | identifier;
@@ -64,7 +70,7 @@ identifier: LETTER (LETTER | DIGIT | '_')*;
 
 literal: integer_literal | float_literal | string_literal | boolean_literal | 'NULL';
 
-integer_literal: DIGIT+;
+integer_literal: DIGIT+; // At most 2^47 - 1: ints are 48 bits wide and wrap around
 float_literal: DIGIT+ '.' DIGIT+;
 string_literal: '\'' CHARACTER* '\'';
 boolean_literal: 'true' | 'false';
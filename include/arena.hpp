@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump-pointer allocator. Memory is carved out of large blocks and released
+// all at once when the arena goes away; nothing is freed individually and no
+// destructors run, so it is meant for trivially destructible data.
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (cursor != nullptr && aligned + size <= reinterpret_cast<uintptr_t>(limit)) {
+            cursor = reinterpret_cast<char *>(aligned + size);
+            return reinterpret_cast<void *>(aligned);
+        }
+        return allocateSlow(size, alignment);
+    }
+
+    template <typename T>
+    T *allocateArray(size_t count) {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Copies text into the arena and returns a view of the copy
+    std::string_view copy(std::string_view text);
+
+    // Bytes reserved from the system, for statistics
+    size_t capacity() const { return reserved; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    size_t blockSize;
+    size_t reserved = 0;
+
+    void *allocateSlow(size_t size, size_t alignment);
+};
+
+#endif // ARENA_H
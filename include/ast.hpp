@@ -0,0 +1,230 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <vector>
+#include "symbols.hpp"
+
+// Nodes refer to each other by index into the tree's node array. Index 0 is a
+// placeholder, so NoNode can mark an absent child.
+typedef uint32_t NodeId;
+const NodeId NoNode = 0;
+
+enum AstKind : uint8_t
+{
+    AstNone,
+    // Declarations
+    AstProgram,             // a, b: list of imports, functions, classes and statements
+    AstFunction,            // a: name, b: extra [body, parameter count, parameters...]
+    AstParameter,           // op: AstType, a: name, b: class name for AstTypeClass
+    AstClass,               // a: name, b: extra [base name, member count, members...]
+    AstImport,              // a: name of the module
+    AstVariable,            // op: AstType, a: name, b: extra [class name, initializer]
+    // Statements
+    AstBlock,               // a, b: list of statements
+    AstExpressionStatement, // a: expression
+    AstIf,                  // a: condition, b: extra [then block, else block or NoNode]
+    AstWhile,               // a: condition, b: body
+    AstFor,                 // a: extra [initializer, condition, step, body]
+    AstReturn,              // a: value
+    AstOutput,              // a: value
+    // Expressions
+    AstInt,                 // a, b: low and high half of the value
+    AstFloat,               // a, b: low and high half of the bits of the double
+    AstString,              // a: atom of the contents
+    AstBool,                // op: 0 or 1
+    AstNull,
+    AstName,                // a: name
+    AstAssign,              // a: name, b: value
+    AstCall,                // a: name, b: extra [argument count, arguments...]
+    AstArray,               // a, b: list of elements
+    AstBinary,              // op: AstOperator, a: left, b: right
+    // Placeholders
+    AstLazyBody,            // a, b: token range of an unparsed function body, op: blocks around it
+    AstKindCount
+};
+
+enum AstType : uint8_t
+{
+    AstTypeInt,
+    AstTypeFloat,
+    AstTypeString,
+    AstTypeBool,
+    AstTypeClass // Named by an atom stored with the node
+};
+
+enum AstOperator : uint8_t
+{
+    AstAdd,
+    AstSubtract,
+    AstMultiply,
+    AstDivide,
+    AstEqual,
+    AstNotEqual,
+    AstLess,
+    AstGreater,
+    AstLessEqual,
+    AstGreaterEqual,
+    AstAnd,
+    AstOr
+};
+
+// Flags on class members
+const uint16_t AstPrivate = 1;
+
+// Every node is the same 16 bytes. What a and b hold depends on the kind, as
+// listed above; "list" means a starts a run of b node ids in the extra array,
+// "extra" means b (or a) is where the node's longer record starts in it.
+struct AstNode
+{
+    AstKind kind;
+    uint8_t op;
+    uint16_t flags;
+    uint32_t offset; // Of the node's first token in the source
+    uint32_t a;
+    uint32_t b;
+};
+
+// A run of node ids inside the extra array. Only valid until the tree grows.
+struct NodeRange
+{
+    const NodeId *first;
+    const NodeId *last;
+
+    const NodeId *begin() const { return first; }
+    const NodeId *end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// The syntax tree of one program. Nodes and their extra records live in two
+// flat arrays, so building a tree costs a handful of allocations however big
+// it gets and freeing it costs two. Children always come before their parent,
+// so the root is the last node and every expression is a contiguous post-order
+// run of nodes ending at its own root, ready to be evaluated front to back.
+// The one exception is a function body parsed lazily, which is appended when
+// it is materialized, after everything else.
+// Names are atoms of the symbol table the tokens were lexed into.
+class Ast
+{
+public:
+    Ast();
+
+    // Sizes the arrays for about tokens tokens, which bounds the node count
+    void reserve(size_t tokens);
+
+    NodeId add(AstKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint8_t op = 0);
+    // Appends values to the extra array and returns where they start
+    uint32_t addExtra(const uint32_t *values, size_t count);
+    uint32_t addExtra(std::initializer_list<uint32_t> values) { return addExtra(values.begin(), values.size()); }
+
+    const AstNode &node(NodeId id) const { return nodes[id]; }
+    AstNode &node(NodeId id) { return nodes[id]; }
+    AstKind kind(NodeId id) const { return nodes[id].kind; }
+    size_t size() const { return nodes.size(); }
+    NodeId root() const { return rootNode; }
+    void setRoot(NodeId id) { rootNode = id; }
+
+    // Program, Block and Array children
+    NodeRange items(NodeId id) const { return range(nodes[id].a, nodes[id].b); }
+
+    NodeId functionBody(NodeId id) const { return extra[nodes[id].b]; }
+    void setFunctionBody(NodeId id, NodeId body) { extra[nodes[id].b] = body; }
+    NodeRange functionParameters(NodeId id) const { return range(nodes[id].b + 2, extra[nodes[id].b + 1]); }
+    Atom classBase(NodeId id) const { return extra[nodes[id].b]; }
+    NodeRange classMembers(NodeId id) const { return range(nodes[id].b + 2, extra[nodes[id].b + 1]); }
+    Atom variableClass(NodeId id) const { return extra[nodes[id].b]; }
+    NodeId variableInitializer(NodeId id) const { return extra[nodes[id].b + 1]; }
+    NodeId ifThen(NodeId id) const { return extra[nodes[id].b]; }
+    NodeId ifElse(NodeId id) const { return extra[nodes[id].b + 1]; }
+    NodeId forInitializer(NodeId id) const { return extra[nodes[id].a]; }
+    NodeId forCondition(NodeId id) const { return extra[nodes[id].a + 1]; }
+    NodeId forStep(NodeId id) const { return extra[nodes[id].a + 2]; }
+    NodeId forBody(NodeId id) const { return extra[nodes[id].a + 3]; }
+    NodeRange callArguments(NodeId id) const { return range(nodes[id].b + 1, extra[nodes[id].b]); }
+    int64_t intValue(NodeId id) const;
+    double floatValue(NodeId id) const;
+
+    // The first node of the post-order run that ends at the expression root
+    NodeId firstNode(NodeId root) const;
+
+    // Bytes held by the node and extra arrays
+    size_t memoryUsage() const;
+
+    // For assembling a program from trees parsed separately. A finished tree
+    // has a body: every node but the placeholder and the root, and every extra
+    // record but the root's list.
+    size_t bodyNodes() const;
+    size_t bodyExtra() const;
+    // Sets the array sizes, leaving room to copy bodies into
+    void resize(size_t nodeCount, size_t extraCount);
+    // Copies the body of other to nodes at.. and extra records extraAt..,
+    // renumbering the references inside it. Bodies may be copied into
+    // disjoint ranges from several threads at once.
+    void copyBody(const Ast &other, NodeId at, uint32_t extraAt);
+
+    // For moving a tree between symbol tables: calls f(Atom &) on every field
+    // that holds an atom, wherever it is stored
+    template <typename F>
+    void forEachAtom(F &&f);
+
+    // Replaces the arrays wholesale, e.g. with ones stored in a module
+    void assign(const AstNode *nodes, size_t nodeCount, const uint32_t *extra, size_t extraCount, NodeId root);
+    const AstNode *nodeData() const { return nodes.data(); }
+    const uint32_t *extraData() const { return extra.data(); }
+    size_t extraSize() const { return extra.size(); }
+
+private:
+    std::vector<AstNode> nodes;
+    std::vector<uint32_t> extra;
+    NodeId rootNode;
+
+    NodeRange range(uint32_t start, uint32_t count) const
+    {
+        return {extra.data() + start, extra.data() + start + count};
+    }
+};
+
+template <typename F>
+void Ast::forEachAtom(F &&f)
+{
+    for (AstNode &node : nodes)
+    {
+        switch (node.kind)
+        {
+        case AstParameter:
+            f(node.a);
+            f(node.b);
+            break;
+        case AstClass:
+        case AstVariable:
+            // The base or class name leads the extra record
+            f(node.a);
+            f(extra[node.b]);
+            break;
+        case AstFunction:
+        case AstImport:
+        case AstString:
+        case AstName:
+        case AstAssign:
+        case AstCall:
+            f(node.a);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// 64-bit literal values split over a and b
+void splitValue(uint64_t value, uint32_t &low, uint32_t &high);
+
+const char *astKindName(AstKind kind);
+const char *astOperatorSpelling(AstOperator op);
+
+// Prints the tree one node per line, indented by depth
+void dumpAst(const Ast &ast, const SymbolTable &symbols, std::ostream &out);
+
+#endif // AST_H
@@ -0,0 +1,116 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "value.hpp"
+
+// Every instruction with its operand count and what it does to the operand
+// stack. Call and Array pop a number of values given by their operand on top
+// of what is listed here. The order is the order of the Opcode values.
+#define MYN_OPCODES(X)                                                                                  \
+    X(Constant, 1, 1)     /* k: push constant k */                                                      \
+    X(Null, 0, 1)                                                                                       \
+    X(True, 0, 1)                                                                                       \
+    X(False, 0, 1)                                                                                      \
+    X(LoadLocal, 1, 1)    /* slot of the current frame */                                               \
+    X(StoreLocal, 1, 0)   /* slot; the value stays on the stack */                                      \
+    X(LoadGlobal, 1, 1)                                                                                 \
+    X(StoreGlobal, 1, 0)                                                                                \
+    X(Pop, 0, -1)                                                                                       \
+    X(Add, 0, -1)                                                                                       \
+    X(Subtract, 0, -1)                                                                                  \
+    X(Multiply, 0, -1)                                                                                  \
+    X(Divide, 0, -1)                                                                                    \
+    X(Equal, 0, -1)                                                                                     \
+    X(NotEqual, 0, -1)                                                                                  \
+    X(Less, 0, -1)                                                                                      \
+    X(Greater, 0, -1)                                                                                   \
+    X(LessEqual, 0, -1)                                                                                 \
+    X(GreaterEqual, 0, -1)                                                                              \
+    X(IntAdd, 0, -1)      /* Operands known to be ints */                                               \
+    X(IntSubtract, 0, -1)                                                                               \
+    X(IntMultiply, 0, -1)                                                                               \
+    X(IntDivide, 0, -1)                                                                                 \
+    X(IntEqual, 0, -1)                                                                                  \
+    X(IntNotEqual, 0, -1)                                                                               \
+    X(IntLess, 0, -1)                                                                                   \
+    X(IntGreater, 0, -1)                                                                                \
+    X(IntLessEqual, 0, -1)                                                                              \
+    X(IntGreaterEqual, 0, -1)                                                                           \
+    X(FloatAdd, 0, -1)    /* Operands known to be floats */                                             \
+    X(FloatSubtract, 0, -1)                                                                             \
+    X(FloatMultiply, 0, -1)                                                                             \
+    X(FloatDivide, 0, -1)                                                                               \
+    X(FloatEqual, 0, -1)                                                                                \
+    X(FloatNotEqual, 0, -1)                                                                             \
+    X(FloatLess, 0, -1)                                                                                 \
+    X(FloatGreater, 0, -1)                                                                              \
+    X(FloatLessEqual, 0, -1)                                                                            \
+    X(FloatGreaterEqual, 0, -1)                                                                         \
+    X(IntToFloat, 0, 0)   /* The int on top */                                                          \
+    X(IntToFloatBelow, 0, 0) /* The int just below the top */                                           \
+    X(Check, 1, 0)        /* ValueType: fails unless the top is one, converting an int to a float */    \
+    X(CheckLocal, 2, 0)   /* slot, ValueType: the same for a local */                                   \
+    X(ToBool, 0, 0)                                                                                     \
+    X(Jump, 1, 0)         /* target */                                                                  \
+    X(JumpIfFalse, 1, -1) /* target; pops the condition */                                              \
+    X(JumpIfTrue, 1, -1)                                                                                \
+    X(Array, 1, 1)        /* count: pops that many elements */                                          \
+    X(Call, 1, 1)         /* function: pops its arguments, pushes the result */                         \
+    X(Return, 0, -1)                                                                                    \
+    X(Output, 0, -1)
+
+enum Opcode : uint8_t
+{
+#define MYN_OPCODE_ENUM(name, operands, effect) Op##name,
+    MYN_OPCODES(MYN_OPCODE_ENUM)
+#undef MYN_OPCODE_ENUM
+    OpcodeCount
+};
+
+const char *opcodeName(Opcode op);
+// Code words taken by the operands of op
+unsigned opcodeOperands(Opcode op);
+
+struct BytecodeFunction
+{
+    Atom name;
+    uint32_t entry;     // First code word
+    uint32_t arity;     // Parameters, which are the first locals
+    uint32_t frameSize; // Local slots, parameters included
+    uint32_t maxStack;  // Deepest the operand stack gets above the locals
+};
+
+// A compiled program. Code is a flat array of words: an opcode followed by
+// its operands. Jump targets are word indices, so the code can be moved or
+// stored as it is. Function 0 runs the top level of the program; variables
+// declared there are globals, the rest are slots in their function's frame.
+struct Bytecode
+{
+    std::vector<uint32_t> code;
+    std::vector<uint32_t> offsets; // Source offset of the instruction each code word belongs to
+    std::vector<Value> constants;
+    std::vector<BytecodeFunction> functions;
+    std::vector<Value> globals; // Initial values
+    Heap heap;                  // String constants
+};
+
+// Compiles the program ast, whose names are atoms of symbols, into out.
+// Declared types are checked on the way, and arithmetic on operands of known
+// types gets instructions that skip looking at the values. Errors such as
+// unknown names or mismatched types go to errors, located through lines; out
+// is only usable when there are none. Function bodies must all be parsed.
+// With checked set, ast is an optimized rewrite of a program that compiled
+// cleanly; type mismatches the rewrite exposed are then left to run-time
+// checks, as they were in the original.
+void compileProgram(const Ast &ast, const SymbolTable &symbols, const LineIndex &lines, Bytecode &out,
+                    Diagnostics &errors, bool checked = false);
+
+// Lists the instructions of every function, one per line
+void dumpBytecode(const Bytecode &program, const SymbolTable &symbols, std::ostream &out);
+
+#endif // BYTECODE_H
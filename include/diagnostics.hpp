@@ -0,0 +1,35 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "token.hpp"
+
+struct Diagnostic
+{
+    SourceLocation location;
+    std::string message;
+};
+
+// Errors collected over a whole run instead of stopping at the first one.
+// Nothing is written while they are collected; print() emits them all at the
+// end in a single write.
+class Diagnostics
+{
+public:
+    void error(SourceLocation location, std::string message);
+
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    const Diagnostic &operator[](size_t i) const { return entries[i]; }
+
+    // One "file:line:column: error: message" line each, then a count
+    void print(std::ostream &out, std::string_view filename) const;
+
+private:
+    std::vector<Diagnostic> entries;
+};
+
+#endif // DIAGNOSTICS_H
@@ -2,80 +2,244 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <unordered_set>
 #include <unordered_map>
+#include "symbols.hpp"
+#include "token.hpp"
 
-enum TokenType
+bool isReservedKeyword(std::string_view word);
+// The keyword type for word, or Identifier when it is not a keyword
+TokenType keywordType(std::string_view word);
+bool isKeywordType(TokenType type);
+
+// The lexer is a table-driven state machine. Every byte maps to a class, and
+// the transition for (state, class) says what to do next. Runs that need no
+// per-byte decisions (whitespace, words, strings, comments) are single
+// actions that hand over to the vectorized scanner.
+enum LexClass : uint8_t
+{
+    LexClassEnd, // Past the last byte
+    LexClassSpace,
+    LexClassQuote,
+    LexClassHash,
+    LexClassWord, // Anything that does not end a word
+    LexClassOpenParen,
+    LexClassCloseParen,
+    LexClassOpenSBracket,
+    LexClassCloseSBracket,
+    LexClassOpenBrace,
+    LexClassCloseBrace,
+    LexClassPlus,
+    LexClassMinus,
+    LexClassStar,
+    LexClassSlash,
+    LexClassEquals,
+    LexClassSemicolon,
+    LexClassComma,
+    LexClassColon,
+    LexClassBang,
+    LexClassAmpersand,
+    LexClassPipe,
+    LexClassLess,
+    LexClassGreater,
+    LexClassCount
+};
+
+enum LexState : uint8_t
+{
+    LexStart,
+    LexAfterSlash,     // Either a division or the start of a block comment
+    LexAfterEquals,    // Either an assignment or "=="
+    LexAfterBang,      // Only valid as the start of "!="
+    LexAfterAngle,     // '<' or '>', maybe followed by '='
+    LexAfterAmpersand, // Only valid as the start of "&&"
+    LexAfterPipe,      // Only valid as the start of "||"
+    LexStateCount
+};
+
+enum LexAction : uint8_t
+{
+    LexStop,             // End of input
+    LexShift,            // Consume the byte and move to the next state
+    LexEmit,             // Consume the byte, which completes a symbol
+    LexEmitBefore,       // The symbol ended before this byte
+    LexSkipSpace,        // Skip a whitespace run
+    LexSkipLineComment,  // Skip to the end of the line
+    LexSkipBlockComment, // Skip past the closing "*/"
+    LexString,           // Scan a quoted string
+    LexWord              // Scan an identifier, number or keyword
+};
+
+struct LexTransition
 {
-    IntNumber,
-    Identifier,
-    AssignmentOperator,
-    OpenParen,
-    CloseParen,
-    ArithmeticOperator,
-    LogicalOperator,
-    OpenBrace,
-    CloseBrace,
-    OpenSBracket,
-    CloseSBracket,
-    String, 
-    Semicolon, 
-    Skip,      
-    Unknown,
-    Comma,
-    FloatNumber,
-    Myn,
-    For,
-    While,
-    Switch,
-    Fun,
-    Class,
-    Break,
-    Case,
-    True,
-    False,
-    Public,
-    Enum,
-    Private,
-    Protected,
-    Void,
-    This,
-    Throw,
-    Try,
-    Catch,
-    Import,
-    Continue,
-    Pass,
-    Null,
-    Elif,
-    Else,
-    If,
-    Static,
-    Return,
-    Input,
-    Output,
-    IntType,
-    FloatType,
-    BooleanType,
-    StringType,
-    Invalid
+    LexAction action;
+    LexState next;
+    TokenType type; // For the emit actions
+};
+
+// Keyword spellings in effect for a lexer run. The default context knows the
+// built-in keywords; one built from a myn.config mapping compiles the remapped
+// spellings into its own lookup table. A context never changes after it is
+// built, so a single one can be shared by every thread lexing with it.
+class LexerContext
+{
+public:
+    LexerContext();
+    explicit LexerContext(const std::unordered_map<std::string, std::string> &config);
+
+    static const LexerContext &defaults();
+
+    // The keyword type for word under this context, or Identifier
+    TokenType keyword(std::string_view word) const
+    {
+        return table.empty() ? keywordType(word) : remappedKeyword(word);
+    }
+
+    uint8_t charClass(char ch) const { return classes[static_cast<unsigned char>(ch)]; }
+    const LexTransition &transition(uint8_t state, uint8_t byteClass) const { return transitions[state][byteClass]; }
+
+private:
+    struct Entry
+    {
+        uint32_t offset; // Into spellings
+        uint32_t length; // 0 marks a free slot
+        TokenType type;
+    };
+
+    std::string spellings;    // Every remapped keyword, back to back
+    std::vector<Entry> table; // Open addressing; empty when nothing is remapped
+    size_t minLength;
+    size_t maxLength;
+
+    uint8_t classes[256];
+    LexTransition transitions[LexStateCount][LexClassCount];
+
+    TokenType remappedKeyword(std::string_view word) const;
+    void buildStateMachine();
 };
 
+struct Scanner;
+
+// Pull-based lexer: each call to next() scans just far enough to produce one
+// token, so tokens can be consumed while the rest of the input is unlexed.
+class Lexer
+{
+public:
+    explicit Lexer(std::string_view sourceCode, SymbolTable &symbols,
+                   const LexerContext &context = LexerContext::defaults());
+
+    // Stores the next token in out; returns false at the end of the input
+    bool next(Token &out);
+
+    std::string_view text() const { return source; }
+    // Continues from position, which must be 0 or where a token ended. The
+    // lexer keeps no other state between tokens.
+    void seek(size_t position) { this->position = position; }
+
+private:
+    std::string_view source;
+    SymbolTable &symbols;
+    const LexerContext &context;
+    const Scanner &scan;
+    size_t position;
+};
+
+// Token source for the parser with a little lookahead. Over a Lexer it keeps
+// only a small ring of tokens, so memory stays constant however large the
+// input is; it can also walk a buffer that was tokenized up front.
+class TokenStream
+{
+public:
+    static const size_t Lookahead = 8; // Must be a power of two
+
+    TokenStream();
+    explicit TokenStream(Lexer &lexer);
+    explicit TokenStream(const TokenBuffer &tokens);
+    // Walks only tokens [first, last) of the buffer, as if nothing came after.
+    // Locations come from a line index of the stream's own, so streams over
+    // one buffer can be used from different threads.
+    TokenStream(const TokenBuffer &tokens, size_t first, size_t last);
+
+    // The k-th token from the current one (k < Lookahead). Past the end this
+    // is an empty Invalid token. The reference stays valid until the stream
+    // advances.
+    const Token &peek(size_t k = 0);
+    // Just the type of peek(k); over a buffer this reads only the kind array
+    TokenType type(size_t k = 0);
+    // Byte offset of peek(k) in the source. Past the end this is where the
+    // next token outside the range starts, or the source size.
+    uint32_t offset(size_t k = 0);
+    // The same as a line and column
+    SourceLocation location(size_t k = 0);
+    void advance();
+    bool atEnd();
+
+    // Over a buffer only: the index of the current token, the index past the
+    // last one walked, and a jump to another index in between
+    size_t position() const { return index; }
+    size_t end() const { return last; }
+    void seek(size_t index);
+
+private:
+    Lexer *lexer;
+    const TokenBuffer *tokens;
+    size_t index; // Of the current token in tokens
+    size_t last;  // End of the tokens walked
+    Token ring[Lookahead];
+    LineIndex lines; // For locations while streaming or over a range
+    bool ownLines;
+    size_t head;
+    size_t count;
+    bool exhausted;
+
+    bool fill(size_t k);
+};
+
+TokenBuffer tokenize(std::string_view sourceCode, SymbolTable &symbols,
+                     const LexerContext &context = LexerContext::defaults());
+
+class ThreadPool;
+
+// Same tokens and atoms as tokenize(), but large inputs are split into chunks
+// at safe boundaries and the chunks are lexed concurrently on the pool
+TokenBuffer tokenizeParallel(std::string_view sourceCode, SymbolTable &symbols, ThreadPool &pool,
+                             const LexerContext &context = LexerContext::defaults());
+// A change to a source: removed bytes at offset were replaced by inserted
+struct TextEdit
+{
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+};
 
-struct Token
+// Which tokens relex() replaced: removed tokens starting at index first gave
+// way to inserted new ones
+struct TokenSplice
 {
-    std::string value;
-    TokenType type;
+    size_t first;
+    size_t removed;
+    size_t inserted;
 };
 
-void INIT_RESERVED_IDENTIFIER();
-std::vector<Token> tokenize(std::string &sourceCode);
-std::vector<Token> tokenize_with_config(std::string &sourcecode, std::unordered_map<std::string, std::string> &config);
-void check_spacing(const std::vector<Token> &tokens);
-TokenType checkTokenType(const std::string &token);
-bool isReservedKeyword(const std::string& word);
+// Brings tokens, lexed from the source before the edit, up to date with
+// newSource, the source after it. Lexing restarts at the end of the last token
+// that the edit cannot have touched and stops as soon as a new token ends
+// where an old one did past the edit, from where on both runs agree; only the
+// offsets of the remaining tokens are shifted. Pass the symbols and context the
+// tokens were lexed with, so the atoms stay consistent.
+TokenSplice relex(TokenBuffer &tokens, std::string_view newSource, const TextEdit &edit,
+                  SymbolTable &symbols, const LexerContext &context = LexerContext::defaults());
+TokenBuffer tokenize_with_config(std::string_view sourcecode, std::unordered_map<std::string, std::string> &config,
+                                 SymbolTable &symbols);
+// Both run the same lexer as tokenize(), with the config's keyword remapping.
+// Prefer the second when lexing more than once: the context is built once.
+TokenBuffer tokenize_with_config(std::string_view sourcecode, const LexerContext &context,
+                                 SymbolTable &symbols);
+void check_spacing(const TokenBuffer &tokens);
+TokenType checkTokenType(std::string_view token);
 bool isSymbol(char ch);
-TokenType getSymbolTokenType(const std::string& symbol);
+TokenType getSymbolTokenType(std::string_view symbol);
 #endif // LEXER_H
@@ -0,0 +1,103 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "ast.hpp"
+#include "source.hpp"
+#include "token_cache.hpp"
+
+// A top-level function, class or variable of a module, by local name index
+struct ModuleExport
+{
+    uint32_t name; // 1 + an index into the module's names
+    NodeId node;
+};
+
+// A compiled module: the syntax tree of one source file, the names it uses
+// and the declarations it exports, in one flat file of fixed-width records.
+// Names are numbered locally and nodes refer to each other by index, so
+// nothing in the file depends on where it is mapped or on the symbol table
+// of the process that wrote it. Opening a module maps the file and checks the
+// header and the section bounds; the arrays are then used in place.
+class Module
+{
+public:
+    Module() = default;
+    Module(const Module &) = delete;
+    Module &operator=(const Module &) = delete;
+
+    // The checksum and the shape of the tree take a pass over the whole file,
+    // so they are only checked the first time a file is seen: cache, when
+    // given, remembers the files that passed by stamp(). Without a cache they
+    // are checked on every open.
+    bool open(const std::string &path, const TokenCache *cache, std::string &error);
+
+    // Whether the module was compiled from a source with this key
+    bool matches(const CacheKey &key) const;
+    // Tells files apart by their checksum, size and modification time
+    uint64_t stamp() const;
+
+    const AstNode *nodes() const { return nodeArray; }
+    size_t nodeCount() const { return nodeTotal; }
+    const uint32_t *extra() const { return extraArray; }
+    size_t extraCount() const { return extraTotal; }
+    NodeId root() const { return rootNode; }
+
+    // Local names; 0 is NoAtom
+    size_t nameCount() const { return nameTotal; }
+    std::string_view name(uint32_t local) const;
+
+    // Sorted by name
+    const ModuleExport *exports() const { return exportArray; }
+    size_t exportCount() const { return exportTotal; }
+    // The top-level declaration called name, NoNode if there is none
+    NodeId find(std::string_view name) const;
+
+    // Copies the tree out, with its names interned into symbols
+    Ast toAst(SymbolTable &symbols) const;
+
+private:
+    SourceFile file;
+    uint64_t checksum = 0;
+    uint64_t modified = 0;
+    uint64_t sourceHash = 0;
+    uint64_t configHash = 0;
+    uint64_t sourceSize = 0;
+    const AstNode *nodeArray = nullptr;
+    size_t nodeTotal = 0;
+    const uint32_t *extraArray = nullptr;
+    size_t extraTotal = 0;
+    NodeId rootNode = NoNode;
+    const ModuleExport *exportArray = nullptr;
+    size_t exportTotal = 0;
+    const uint32_t *nameEnds = nullptr;
+    size_t nameTotal = 0;
+    const char *nameBytes = nullptr;
+    size_t nameSize = 0;
+
+    bool verify(const std::string &path, std::string &error) const;
+};
+
+// Where the module compiled from the source at path goes: right next to it
+std::string modulePath(const std::string &path);
+
+// Writes the module for ast, whose names are atoms of symbols, replacing any
+// existing file atomically. Trees with unparsed lazy bodies are refused.
+bool writeModule(const std::string &path, const Ast &ast, const SymbolTable &symbols, const CacheKey &key,
+                 std::string &error);
+
+// Resolves the imports of program, whose names are atoms of symbols. Every
+// name the program uses but declares nowhere is looked up in the modules it
+// imports, in order, and the declaration found is copied in at the top level,
+// along with whatever that declaration uses from its own module or from the
+// ones that module imports. Exports are found by binary search in the mapped
+// files, and only the declarations needed are read. "import name;" refers to
+// the module --emit-module wrote for name.myn, in directory for the program
+// and next to the importing module for a module. The top-level statements of
+// a module do not run, and a name cannot come from two places.
+bool linkImports(Ast &program, SymbolTable &symbols, const std::string &directory, const TokenCache *cache,
+                 std::string &error);
+
+#endif // MODULE_H
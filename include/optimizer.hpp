@@ -0,0 +1,63 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+
+// Rewrites of the syntax tree, in the order they run in a round
+enum OptimizationPass : uint8_t
+{
+    PassConstantFolding, // Operators on literals become the literal they make
+    PassDeadCode,        // Branches never taken, statements after a return, unused locals
+    PassCopyPropagation, // Reads of a local that only ever holds a copy read the original
+    PassInlining,        // Calls of small functions that just return an expression become it
+    PassCount
+};
+
+struct PassStats
+{
+    size_t rewrites;     // Places the pass changed
+    long nodesRemoved;   // Net, over every run of the pass; negative for growth
+};
+
+// What the inliner made of one call
+struct InlineDecision
+{
+    uint32_t offset; // Of the call
+    Atom callee;
+    Atom caller; // NoAtom for the top level
+    bool inlined;
+    std::string reason; // Why not, or what inlining cost
+};
+
+struct OptimizationStats
+{
+    PassStats passes[PassCount];
+    std::vector<InlineDecision> inlining; // The last decision about each call, in source order
+    unsigned rounds;
+    size_t nodesBefore;
+    size_t nodesAfter;
+};
+
+// Highest level optimizeAst knows
+const unsigned MaxOptimizationLevel = 2;
+
+const char *passName(OptimizationPass pass);
+
+// Runs the passes for level over a cleanly parsed program and returns the
+// result, which behaves the same when compiled and run. Level 1 folds
+// constants and removes dead code, level 2 also propagates copies and inlines
+// small functions, within a budget of nodes the program may grow by; the passes
+// repeat while they find something to do, since each can open up work for
+// the others. Code that is removed is not compiled, so the tree has to be
+// checked by compiling it before it is optimized. Strings made by folding are
+// interned into symbols.
+Ast optimizeAst(const Ast &ast, SymbolTable &symbols, unsigned level, OptimizationStats &stats);
+
+// A table of what each pass did
+void printOptimizationStats(const OptimizationStats &stats, std::ostream &out);
+
+#endif // OPTIMIZER_H
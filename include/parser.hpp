@@ -2,38 +2,146 @@
 #define PARSER_H
 
 #include <vector>
+#include <ostream>
+#include "ast.hpp"
+#include "diagnostics.hpp"
 #include "lexer.hpp"
-#include <cassert>  
+#include <cassert>
 
 #define LOG_ERROR(msg) std::cerr << "[ERROR] " << msg << std::endl
 #define LOG_WARNING(msg) std::cerr << "[WARNING] " << msg << std::endl
 #define LOG_DEBUG(msg) std::cout << "[DEBUG] " << msg << std::endl
 
+// Prints as line:column
+inline std::ostream &operator<<(std::ostream &out, const SourceLocation &location) {
+    return out << location.line << ':' << location.column;
+}
+
+// What the statement parser is in the middle of. Constructs that contain a
+// block get a frame on an explicit stack instead of a C++ call, so nesting
+// depth costs heap memory rather than native stack.
+enum ParseFrameKind : uint8_t
+{
+    FrameProgram,  // Top-level items until the end of the input
+    FrameBlock,    // Statements until '}'
+    FrameClass,    // Members until '}'; a: name, b: base, c: current section
+    FrameFunction, // Waiting for the body; a: name
+    FrameIf,       // Waiting for a block; a: condition, b: then block once parsed
+    FrameWhile,    // Waiting for the body; a: condition
+    FrameFor       // Waiting for the body; a, b, c: initializer, condition, step
+};
+
+struct ParseFrame
+{
+    ParseFrameKind kind;
+    uint32_t offset; // Of the construct's first token
+    uint32_t mark;   // Scratch entries below this belong to enclosing frames
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+// Parses the grammar in docs/myn.g4 into an Ast. On top of the grammar,
+// statements may also appear at the top level of a program. Statements and
+// blocks run off an explicit stack of frames; only expressions recurse.
+// A syntax error is recorded in diagnostics() and the parser skips to the end
+// of the broken statement, so a single pass reports every error. The tree of
+// a program with errors is missing the broken statements.
 class Parser
 {
 public:
-    Parser(const std::vector<Token> &tokens);
+    // Deepest block nesting accepted unless setNestingLimit() says otherwise
+    static const size_t DefaultNestingLimit = 100000;
+    // Expressions still recurse, so parentheses, arrays and calls have a fixed
+    // cap that keeps them well within the native stack
+    static const size_t ExpressionNestingLimit = 2000;
+
+    Parser(const TokenBuffer &tokens);
+    // Parses only tokens [first, last) of the buffer, as a program of its own
+    Parser(const TokenBuffer &tokens, size_t first, size_t last);
+    // Parses while the stream is still being lexed
+    Parser(TokenStream &stream);
     void parse();
+    // Builds the same tree as parse() with the top-level declarations split
+    // over the pool. Only for parsers over a whole token buffer.
+    void parseParallel(ThreadPool &pool);
+
+    // With lazy bodies, parse() skips each function body over a token buffer
+    // by brace matching and leaves an AstLazyBody in its place; materialize()
+    // parses it when it is first needed. A stream cannot go back, so parsers
+    // over a stream always parse bodies right away.
+    void setLazyBodies(bool lazy) { lazyBodies = lazy; }
+    // Parses the body of function if that has not happened yet and returns
+    // it. Errors in it are added to diagnostics(). The parser has to outlive
+    // the tree for as long as bodies may still be materialized.
+    NodeId materialize(NodeId function);
+
+    // 0 lifts the limit
+    void setNestingLimit(size_t limit) { nestingLimit = limit; }
+
+    // The tree built by parse()
+    Ast &ast() { return tree; }
+    // Errors found by parse(), empty if the program is well-formed
+    const Diagnostics &diagnostics() const { return errors; }
 
 private:
-    const std::vector<Token> &tokens;
-    size_t currentIndex;
+    const TokenBuffer *tokens; // Null when parsing a stream
+    TokenStream ownStream;     // Used when parsing a token buffer
+    TokenStream &stream;
+    Ast tree;
+    std::vector<NodeId> scratch; // Lists being collected, used as a stack
+    std::vector<ParseFrame> frames;
+    size_t nestingLimit = DefaultNestingLimit;
+    bool lazyBodies = false;
+    NodeId result = NoNode; // What the outermost frame produced
+    size_t blockDepth = 0;
+    size_t expressionDepth = 0;
+    Diagnostics errors;
+    uint64_t consumed = 0; // Tokens advanced over, to tell whether recovery moved on
 
+    // Statement level
+    void run();
+    void step();
+    void finish(NodeId done);
+    bool skipBody();
+    void recover(size_t savedFrames, size_t savedScratch, uint64_t savedConsumed);
     void parseStatement();
-    Token currentToken() const;
+    void parseClassMember(ParseFrame &frame);
+    void openFunction();
+    void openClass();
+    void openBlock();
+    void push(ParseFrameKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+    NodeId closeList(const ParseFrame &frame, AstKind kind);
+    NodeId deliver(NodeId child);
+    NodeId parseVariableDeclaration();
+    NodeId parseParameter();
+    NodeId parseReturnStatement();
+    NodeId parseOutputStatement();
+    NodeId parseImport();
+
+    // Expression level
+    NodeId parseExpression(int minPrecedence = 1);
+    NodeId parsePrimary();
+    NodeId parseFunctionCall();
+    NodeId parseArray();
+
+    const Token &currentToken();
+    TokenType currentType();
+    uint32_t offset(); // Of the current token
+    SourceLocation location(); // Of the current token, for diagnostics
     void advance();
-    void handleKeyword(const Token &token);
+    // Records an error at the current token and abandons the statement
+    [[noreturn]] void fail(const std::string &message);
+    void expect(TokenType type, const char *what);
+    void closeBrace(const char *what);
+    Atom expectName(const char *what);
+    bool atDeclaration();
+    void parseType(uint8_t &type, Atom &className);
+    // Moves the scratch entries above mark into the extra array after head
+    uint32_t takeList(std::initializer_list<uint32_t> head, size_t mark);
 
 public:
-    void parseVariableDeclaration();
-    void parseFunctionDefinition();
-    void parseWhileLoop();
-    void parseForLoop();
-    void parseFunctionCall();
-    void parseOutputStatement();
-    void ParsingError(std::string error);
     bool hasMoreTokens();
-    void parseFunctionStatement();
 };
 
-#endif // PARSER_H
\ No newline at end of file
+#endif // PARSER_H
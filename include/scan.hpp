@@ -0,0 +1,32 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+
+// Bulk scanning primitives used by the lexer's hot loop. Each function looks
+// at data[from, size) and returns the index of the first byte it is searching
+// for, or size when there is none. The vector versions classify 16 (SSE2) or
+// 32 (AVX2) bytes per step; the best one for the running CPU is picked once.
+struct Scanner
+{
+    // First byte that ends a word: whitespace, a quote, '#' or a symbol
+    size_t (*word)(const char *data, size_t size, size_t from);
+    // First byte that is not ' ', '\t', '\n' or '\r'
+    size_t (*space)(const char *data, size_t size, size_t from);
+    // First occurrence of ch (closing quotes, end of '#' comments)
+    size_t (*find)(const char *data, size_t size, size_t from, char ch);
+    // Index of the '*' of the first "*/"
+    size_t (*commentEnd)(const char *data, size_t size, size_t from);
+    // First quote, '#' or '/', the bytes that can open a string or a comment
+    size_t (*stringOrComment)(const char *data, size_t size, size_t from);
+    const char *name;
+};
+
+// The scanner for this CPU. Setting MYN_SIMD to scalar, sse2 or avx2 forces a
+// particular implementation, which is handy when comparing them.
+const Scanner &scanner();
+
+// True for the bytes that end a word, see Scanner::word
+bool isWordDelimiter(char ch);
+
+#endif // SCAN_H
@@ -0,0 +1,35 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole source file. Regular files are memory-mapped so
+// the lexer works straight on the page cache; pipes, stdin ("-") and anything
+// that cannot be mapped are read into an owned buffer instead. Tokens are views
+// into text(), so the SourceFile must outlive them.
+class SourceFile
+{
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    std::string_view text() const { return std::string_view(data, size); }
+    bool isMapped() const { return mapped; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer; // Backing storage when the file is not mapped
+
+    bool readAll(int fd, std::string &error);
+};
+
+#endif // SOURCE_H
@@ -0,0 +1,43 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "arena.hpp"
+
+// Interned names are identified by a small integer. Atom 0 is never handed
+// out, so it can mark tokens that have no name.
+typedef uint32_t Atom;
+const Atom NoAtom = 0;
+
+// Stores each distinct identifier or string literal once, in an arena, and
+// maps it to an Atom. Comparing or hashing names is then an integer operation.
+// A table is not thread-safe; give each thread its own or lock around it.
+class SymbolTable
+{
+public:
+    SymbolTable();
+
+    Atom intern(std::string_view text);
+    // The atom for text if it was interned before, NoAtom otherwise
+    Atom find(std::string_view text) const;
+    std::string_view name(Atom atom) const { return names[atom]; }
+
+    // Number of atoms handed out, plus one for NoAtom
+    size_t size() const { return names.size(); }
+
+private:
+    Arena arena;
+    std::vector<std::string_view> names; // Indexed by atom
+    std::vector<uint32_t> hashes;        // Indexed by atom
+    std::vector<Atom> slots;             // Open addressing, NoAtom marks a free slot
+
+    void grow();
+};
+
+// The process-wide table the driver interns into. It is not synchronized, so
+// the lexer never falls back to it: every entry point takes its table explicitly.
+SymbolTable &globalSymbols();
+
+#endif // SYMBOLS_H
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for the front end's data-parallel phases
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Workers plus the calling thread, which also takes part in parallelFor
+    size_t concurrency() const { return workers.size() + 1; }
+
+    // Runs task(0) .. task(count - 1) spread over the pool and returns once all
+    // of them have finished
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void work();
+};
+
+// Pool shared by the whole process, sized to the machine on first use
+ThreadPool &sharedThreadPool();
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,157 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "symbols.hpp"
+
+enum TokenType
+{
+    IntNumber,
+    Identifier,
+    AssignmentOperator,
+    OpenParen,
+    CloseParen,
+    ArithmeticOperator,
+    LogicalOperator,
+    OpenBrace,
+    CloseBrace,
+    OpenSBracket,
+    CloseSBracket,
+    String, 
+    Semicolon, 
+    Skip,      
+    Unknown,
+    Comma,
+    FloatNumber,
+    Myn,
+    For,
+    While,
+    Switch,
+    Fun,
+    Class,
+    Break,
+    Case,
+    True,
+    False,
+    Public,
+    Enum,
+    Private,
+    Protected,
+    Void,
+    This,
+    Throw,
+    Try,
+    Catch,
+    Import,
+    Continue,
+    Pass,
+    Null,
+    Elif,
+    Else,
+    If,
+    Static,
+    Return,
+    Input,
+    Output,
+    IntType,
+    FloatType,
+    BooleanType,
+    StringType,
+    Colon,
+    ComparisonOperator,
+    Invalid
+};
+
+// A token does not own its text: value is a view into the source buffer that
+// was lexed, so that buffer must outlive the token.
+// Identifiers and string literals also carry the atom of their interned name
+// (a string literal is interned without its quotes); other tokens have NoAtom.
+struct Token
+{
+    std::string_view value;
+    TokenType type;
+    Atom atom;
+};
+
+// 1-based line and column of a byte in the source
+struct SourceLocation
+{
+    uint32_t line;
+    uint32_t column;
+};
+
+// Maps byte offsets to lines and columns. The line starts are only collected
+// the first time a location is asked for, so inputs without diagnostics never
+// pay for them. Building is not synchronized: share an index between threads
+// only after it has answered once.
+class LineIndex
+{
+public:
+    explicit LineIndex(std::string_view source = std::string_view()) : source(source) {}
+
+    SourceLocation locate(uint32_t offset) const;
+
+private:
+    std::string_view source;
+    mutable std::vector<uint32_t> lineStarts; // Empty until first used
+};
+
+// Lexed tokens as parallel arrays: one byte of kind and the offset and length
+// of the text in the source, plus the atom, per token. That is 13 bytes a
+// token instead of a 24-byte Token, and a scan over the kinds alone touches
+// only one byte each. Offsets are 32 bits, so sources are limited to 4 GiB.
+// Like Token, the buffer views the source, which must outlive it.
+class TokenBuffer
+{
+public:
+    static const size_t MaxSourceSize = UINT32_MAX;
+
+    // Throws std::length_error for sources over MaxSourceSize
+    explicit TokenBuffer(std::string_view source = std::string_view());
+
+    void reserve(size_t count);
+    void resize(size_t count);
+    void set(size_t i, TokenType type, uint32_t offset, uint32_t length, Atom atom)
+    {
+        kinds[i] = static_cast<uint8_t>(type);
+        offsets[i] = offset;
+        lengths[i] = length;
+        atoms[i] = atom;
+    }
+    // token.value must point into the source
+    void push(const Token &token);
+    // Replaces count tokens at first with those of replacement, adds shift to
+    // the offsets of the tokens after them, and takes over the source of
+    // replacement. Used to patch the buffer after an edit.
+    void splice(size_t first, size_t count, const TokenBuffer &replacement, int64_t shift);
+
+    size_t size() const { return kinds.size(); }
+    bool empty() const { return kinds.empty(); }
+
+    TokenType type(size_t i) const { return static_cast<TokenType>(kinds[i]); }
+    uint32_t offset(size_t i) const { return offsets[i]; }
+    uint32_t length(size_t i) const { return lengths[i]; }
+    uint32_t end(size_t i) const { return offsets[i] + lengths[i]; }
+    Atom atom(size_t i) const { return atoms[i]; }
+    std::string_view value(size_t i) const { return text.substr(offsets[i], lengths[i]); }
+    Token token(size_t i) const { return {value(i), type(i), atoms[i]}; }
+
+    std::string_view source() const { return text; }
+    SourceLocation location(size_t i) const { return lines.locate(offsets[i]); }
+    const LineIndex &lineIndex() const { return lines; }
+
+    // Bytes held by the token arrays
+    size_t memoryUsage() const;
+
+private:
+    std::string_view text;
+    std::vector<uint8_t> kinds; // TokenType, which fits in a byte
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<Atom> atoms;
+    LineIndex lines;
+};
+
+#endif // TOKEN_H
@@ -0,0 +1,68 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "token.hpp"
+
+// 64-bit hash of arbitrary bytes, fast enough to run over whole sources
+uint64_t hashBytes(std::string_view bytes, uint64_t seed = 0);
+// Hash of a myn.config mapping that does not depend on its iteration order
+uint64_t hashConfig(const std::unordered_map<std::string, std::string> &config);
+
+// Identifies a cache entry: the source bytes, the keyword mapping they were
+// lexed under and the parser options that decide whether they parse at all
+struct CacheKey
+{
+    uint64_t source;
+    uint64_t config; // The mapping and the parser options together
+    uint64_t size;   // Of the source, as a cheap extra check
+};
+
+CacheKey cacheKey(std::string_view source, uint64_t configHash, uint64_t nestingLimit);
+
+class Ast;
+
+// A directory of lexed and parsed sources. Each entry holds the token arrays
+// and the names of the atoms they refer to, in a flat binary layout that is
+// mapped back in on a hit, and next to them the syntax tree as a module.
+// Entries are only written for sources that parsed cleanly, so a hit skips
+// the front end altogether. The directory also remembers which modules have
+// passed their checks, so each file is only checked once.
+class TokenCache
+{
+public:
+    explicit TokenCache(std::string directory) : directory(std::move(directory)) {}
+
+    // $MYN_CACHE_DIR, else $XDG_CACHE_HOME/myn, else ~/.cache/myn
+    static std::string defaultDirectory();
+
+    // Fills tokens and ast for source from the entry for key, interning the
+    // names into symbols. False when there is no usable entry.
+    bool load(const CacheKey &key, std::string_view source, SymbolTable &symbols, TokenBuffer &tokens,
+              Ast &ast) const;
+    // Writes the entry for key; an existing one is replaced atomically
+    bool store(const CacheKey &key, const TokenBuffer &tokens, const Ast &ast, const SymbolTable &symbols,
+               std::string &error) const;
+
+    // Whether a module with this Module::stamp() passed its checks before
+    bool trusts(uint64_t stamp) const;
+    // Records that it did. A directory that cannot be written only means the
+    // checks run again next time.
+    void trust(uint64_t stamp) const;
+
+private:
+    std::string directory;
+
+    // The file of the entry for key holding the tokens or the tree
+    std::string entryPath(const CacheKey &key, const char *extension) const;
+    // The empty file that marks a module as checked
+    std::string trustPath(uint64_t stamp) const;
+    bool loadTokens(const CacheKey &key, std::string_view source, SymbolTable &symbols, TokenBuffer &tokens) const;
+    bool storeTokens(const CacheKey &key, const TokenBuffer &tokens, const SymbolTable &symbols,
+                     std::string &error) const;
+};
+
+#endif // TOKEN_CACHE_H
@@ -0,0 +1,178 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum ValueType : uint8_t
+{
+    ValueNull,
+    ValueBool,
+    ValueInt,
+    ValueFloat,
+    ValueString,
+    ValueArray
+};
+
+// Strings and arrays live on a Heap; values only point at them
+struct Object
+{
+    ValueType type;
+    // Reached by the collection under way. Set on objects of other heaps too,
+    // which are never freed, hence mutable.
+    mutable bool marked;
+};
+
+class Value;
+
+struct StringObject : Object
+{
+    std::string text;
+};
+
+struct ArrayObject : Object
+{
+    std::vector<Value> items;
+};
+
+// A runtime value of any Myn type in one 64-bit word, NaN-boxed: a float is
+// its own bits, and everything else hides in the payload of negative quiet
+// NaNs that arithmetic never produces. The top 16 bits tell them apart:
+//   below 0xFFF9  float; NaNs are stored as the one canonical NaN
+//   0xFFF9        NULL
+//   0xFFFA        bool, in bit 0
+//   0xFFFB        int, two's complement
+//   0xFFFC        pointer to an Object, which fits in 48 bits
+// A Myn int is therefore 48 bits wide, and arithmetic on ints wraps around at
+// that width. NULL, bools, floats and ints never touch the heap, and copying
+// a value never allocates.
+class Value
+{
+public:
+    Value() = default;
+
+    // Range of a Myn int
+    static const int64_t MinInt = -(int64_t(1) << 47);
+    static const int64_t MaxInt = (int64_t(1) << 47) - 1;
+
+    static Value null() { return Value(NullTag); }
+    static Value boolean(bool flag) { return Value(BoolTag | flag); }
+    // Keeps the low 48 bits, so a result computed in 64 bits wraps as it should
+    static Value integer(int64_t integer) { return Value(IntTag | (static_cast<uint64_t>(integer) & PayloadMask)); }
+    static Value number(double number) {
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        return Value(number != number ? CanonicalNaN : bits);
+    }
+    static Value object(Object *object) {
+        uint64_t address = reinterpret_cast<uintptr_t>(object);
+        assert((address & ~PayloadMask) == 0);
+        return Value(ObjectTag | address);
+    }
+
+    ValueType type() const {
+        switch (bits >> 48) {
+        case NullTag >> 48:
+            return ValueNull;
+        case BoolTag >> 48:
+            return ValueBool;
+        case IntTag >> 48:
+            return ValueInt;
+        case ObjectTag >> 48:
+            return pointer()->type;
+        default:
+            return ValueFloat;
+        }
+    }
+    bool isNull() const { return bits == NullTag; }
+    bool isBool() const { return bits >> 48 == BoolTag >> 48; }
+    bool isInt() const { return bits >> 48 == IntTag >> 48; }
+    bool isFloat() const { return bits < NullTag; }
+    bool isString() const { return isObject(ValueString); }
+    bool isArray() const { return isObject(ValueArray); }
+
+    bool asBool() const { return bits & 1; }
+    int64_t asInt() const { return static_cast<int64_t>(bits << 16) >> 16; }
+    double asFloat() const {
+        double number;
+        std::memcpy(&number, &bits, sizeof(number));
+        return number;
+    }
+    const std::string &asString() const { return static_cast<const StringObject *>(pointer())->text; }
+    const std::vector<Value> &asArray() const { return static_cast<const ArrayObject *>(pointer())->items; }
+    const Object *asObject() const { return pointer(); }
+
+    // The same bits are the same value, except that strings can also be equal
+    // with different bits. An int has just the one encoding.
+    uint64_t raw() const { return bits; }
+
+private:
+    static const uint64_t PayloadMask = (uint64_t(1) << 48) - 1;
+    static const uint64_t CanonicalNaN = 0x7FF8000000000000ull;
+    static const uint64_t NullTag = 0xFFF9000000000000ull;
+    static const uint64_t BoolTag = 0xFFFA000000000000ull;
+    static const uint64_t IntTag = 0xFFFB000000000000ull;
+    static const uint64_t ObjectTag = 0xFFFC000000000000ull;
+
+    uint64_t bits;
+
+    explicit Value(uint64_t bits) : bits(bits) {}
+
+    const Object *pointer() const { return reinterpret_cast<const Object *>(bits & PayloadMask); }
+    bool isObject(ValueType type) const { return bits >> 48 == ObjectTag >> 48 && pointer()->type == type; }
+};
+
+static_assert(sizeof(Value) == 8, "values are one word");
+
+// Owns the objects of one program run, or the constants of one program.
+// Whoever holds the values can free the objects they no longer reach by
+// marking every value still in use and then sweeping. Objects of another heap
+// may be marked as well, as long as they never point into this one.
+class Heap
+{
+public:
+    Heap() = default;
+    Heap(Heap &&other) noexcept;
+    Heap &operator=(Heap &&other) noexcept;
+    ~Heap();
+
+    Value string(std::string text);
+    Value array(const Value *items, size_t count);
+
+    // Whether enough was allocated since the last sweep to make another worth it
+    bool due() const { return allocated >= limit; }
+    // Marks value and everything reachable from it
+    void mark(Value value);
+    // Frees every object of this heap left unmarked and unmarks the rest
+    void sweep();
+
+    size_t objectCount() const { return objects.size(); }
+
+private:
+    // A sweep is due after twice as many bytes as were live after the last
+    static const size_t MinLimit = 4 << 20;
+
+    std::vector<Object *> objects;
+    std::vector<const Object *> pending; // Marked, contents not yet
+    size_t allocated = 0;                // Bytes since the last sweep
+    size_t limit = MinLimit;
+
+    static size_t footprint(const Object *object);
+    static void destroy(Object *object);
+    void clear();
+};
+
+const char *valueTypeName(ValueType type);
+
+// false, NULL, 0, 0.0 and '' are false, everything else true
+bool truthy(Value value);
+// Numbers compare by value across int and float, strings by contents and
+// arrays by identity
+bool equal(Value left, Value right);
+// Appends value as output() prints it
+void appendValue(std::string &out, Value value);
+
+#endif // VALUE_H
@@ -0,0 +1,76 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+
+// An error while a program runs, such as a division by zero. offset is the
+// source offset of the instruction that failed.
+class RuntimeError : public std::runtime_error {
+public:
+    explicit RuntimeError(const std::string &message, uint32_t offset = 0)
+        : std::runtime_error(message), offset(offset) {}
+
+    uint32_t offset;
+};
+
+// Runs compiled programs. Where the compiler supports it (GCC and Clang) the
+// code is direct-threaded: each opcode is replaced by the address of its
+// handler once, up front, and every handler jumps straight to the next one
+// with a computed goto. Elsewhere a switch does the dispatch.
+// Locals and operands of all active calls share one contiguous stack, and the
+// call frames another.
+class VM
+{
+public:
+    // Values on the stack, for the locals and operands of every active call
+    static const size_t StackSize = 1 << 20;
+    static const size_t MaxCallDepth = 1 << 16;
+
+    VM(const Bytecode &program, std::ostream &out);
+
+    // Runs the top level of the program to its end. Throws RuntimeError.
+    void run();
+
+    // Instructions executed so far
+    uint64_t instructionCount() const { return executed; }
+    // Objects made while running that have not been freed yet
+    size_t heapObjects() const { return heap.objectCount(); }
+
+private:
+    // A code word, with opcodes turned into handler addresses
+    union Slot {
+        const void *handler;
+        uint32_t operand;
+    };
+
+    struct CallFrame
+    {
+        const Slot *returnTo;
+        Value *base;
+    };
+
+    const Bytecode &program;
+    std::ostream &out;
+    std::vector<Slot> code;
+    std::unique_ptr<Value[]> stack;
+    std::unique_ptr<CallFrame[]> frames;
+    std::vector<Value> globals;
+    Heap heap;          // Objects made while running, collected as the run goes
+    std::string output; // Written out in large pieces
+    uint64_t executed = 0;
+
+    void collect(const Value *sp);
+    void flush();
+};
+
+// What the generic instruction for op, Add through GreaterEqual, makes of
+// left and right. Throws RuntimeError where the instruction would fail.
+Value applyOperator(Opcode op, Value left, Value right, Heap &heap);
+
+#endif // VM_H
@@ -0,0 +1,31 @@
+#include "arena.hpp"
+#include <cstring>
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {}
+
+void *Arena::allocateSlow(size_t size, size_t alignment) {
+    // Oversized requests get a block of their own so the current one keeps
+    // serving small allocations
+    size_t needed = size + alignment;
+    if (needed > blockSize / 4) {
+        blocks.emplace_back(new char[needed]);
+        reserved += needed;
+        uintptr_t start = reinterpret_cast<uintptr_t>(blocks.back().get());
+        return reinterpret_cast<void *>((start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    blocks.emplace_back(new char[blockSize]);
+    reserved += blockSize;
+    cursor = blocks.back().get();
+    limit = cursor + blockSize;
+    return allocate(size, alignment);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    char *storage = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(storage, text.data(), text.size());
+    return std::string_view(storage, text.size());
+}
@@ -0,0 +1,325 @@
+#include "ast.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+
+Ast::Ast() : nodes(1, AstNode{AstNone, 0, 0, 0, 0, 0}), rootNode(NoNode) {}
+
+void Ast::reserve(size_t tokens) {
+    // Almost every node consumes a token of its own, and every list entry or
+    // extra field belongs to one node
+    nodes.reserve(tokens + 2);
+    extra.reserve(tokens + 16);
+}
+
+NodeId Ast::add(AstKind kind, uint32_t offset, uint32_t a, uint32_t b, uint8_t op) {
+    nodes.push_back(AstNode{kind, op, 0, offset, a, b});
+    return static_cast<NodeId>(nodes.size() - 1);
+}
+
+uint32_t Ast::addExtra(const uint32_t *values, size_t count) {
+    uint32_t start = static_cast<uint32_t>(extra.size());
+    extra.insert(extra.end(), values, values + count);
+    return start;
+}
+
+int64_t Ast::intValue(NodeId id) const {
+    return static_cast<int64_t>(static_cast<uint64_t>(nodes[id].b) << 32 | nodes[id].a);
+}
+
+double Ast::floatValue(NodeId id) const {
+    uint64_t bits = static_cast<uint64_t>(nodes[id].b) << 32 | nodes[id].a;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+NodeId Ast::firstNode(NodeId id) const {
+    for (;;) {
+        const AstNode &node = nodes[id];
+        switch (node.kind) {
+        case AstBinary:
+            id = node.a;
+            break;
+        case AstAssign:
+            id = node.b;
+            break;
+        case AstCall:
+            if (callArguments(id).empty()) {
+                return id;
+            }
+            id = *callArguments(id).begin();
+            break;
+        case AstArray:
+            if (items(id).empty()) {
+                return id;
+            }
+            id = *items(id).begin();
+            break;
+        default:
+            return id;
+        }
+    }
+}
+
+size_t Ast::memoryUsage() const {
+    return nodes.capacity() * sizeof(AstNode) + extra.capacity() * sizeof(uint32_t);
+}
+
+size_t Ast::bodyNodes() const {
+    assert(rootNode + 1 == nodes.size());
+    return nodes.size() - 2;
+}
+
+size_t Ast::bodyExtra() const {
+    // The root's list is the last thing added to extra
+    assert(nodes[rootNode].a + nodes[rootNode].b == extra.size());
+    return nodes[rootNode].a;
+}
+
+void Ast::resize(size_t nodeCount, size_t extraCount) {
+    nodes.resize(nodeCount);
+    extra.resize(extraCount);
+}
+
+void Ast::copyBody(const Ast &other, NodeId at, uint32_t extraAt) {
+    const uint32_t nodeShift = at - 1;
+    auto node = [nodeShift](uint32_t id) { return id == NoNode ? NoNode : id + nodeShift; };
+
+    // Records are copied as they are, then the node ids in them renumbered
+    // through the node that owns them
+    std::copy(other.extra.begin(), other.extra.begin() + other.bodyExtra(), extra.begin() + extraAt);
+    uint32_t *records = extra.data() + extraAt;
+    auto nodeList = [&](uint32_t start, uint32_t count) {
+        for (uint32_t i = start; i < start + count; ++i) {
+            records[i] = node(records[i]);
+        }
+    };
+
+    for (NodeId id = 1; id < other.rootNode; ++id) {
+        AstNode copy = other.nodes[id];
+        switch (copy.kind) {
+        case AstBlock:
+        case AstArray:
+            nodeList(copy.a, copy.b);
+            copy.a += extraAt;
+            break;
+        case AstFunction:
+        case AstClass:
+            if (copy.kind == AstFunction) {
+                nodeList(copy.b, 1); // The body
+            }
+            nodeList(copy.b + 2, records[copy.b + 1]);
+            copy.b += extraAt;
+            break;
+        case AstVariable:
+            nodeList(copy.b + 1, 1);
+            copy.b += extraAt;
+            break;
+        case AstIf:
+            copy.a = node(copy.a);
+            nodeList(copy.b, 2);
+            copy.b += extraAt;
+            break;
+        case AstFor:
+            nodeList(copy.a, 4);
+            copy.a += extraAt;
+            break;
+        case AstCall:
+            nodeList(copy.b + 1, records[copy.b]);
+            copy.b += extraAt;
+            break;
+        case AstExpressionStatement:
+        case AstReturn:
+        case AstOutput:
+            copy.a = node(copy.a);
+            break;
+        case AstWhile:
+        case AstBinary:
+            copy.a = node(copy.a);
+            copy.b = node(copy.b);
+            break;
+        case AstAssign:
+            copy.b = node(copy.b);
+            break;
+        default:
+            // Parameters, imports, literals and lazy bodies refer to no other node
+            assert(copy.kind != AstProgram);
+            break;
+        }
+        nodes[id + nodeShift] = copy;
+    }
+}
+
+void Ast::assign(const AstNode *nodes, size_t nodeCount, const uint32_t *extra, size_t extraCount, NodeId root) {
+    this->nodes.assign(nodes, nodes + nodeCount);
+    this->extra.assign(extra, extra + extraCount);
+    rootNode = root;
+}
+
+void splitValue(uint64_t value, uint32_t &low, uint32_t &high) {
+    low = static_cast<uint32_t>(value);
+    high = static_cast<uint32_t>(value >> 32);
+}
+
+const char *astKindName(AstKind kind) {
+    static const char *const names[AstKindCount] = {
+        "None", "Program", "Function", "Parameter", "Class", "Import", "Variable", "Block", "ExpressionStatement",
+        "If",   "While",   "For",      "Return",    "Output", "Int",   "Float",    "String", "Bool",
+        "Null", "Name",    "Assign",   "Call",      "Array",  "Binary", "LazyBody",
+    };
+    return kind < AstKindCount ? names[kind] : "?";
+}
+
+const char *astOperatorSpelling(AstOperator op) {
+    static const char *const spellings[] = {"+", "-", "*", "/", "==", "!=", "<", ">", "<=", ">=", "&&", "||"};
+    return op < sizeof(spellings) / sizeof(spellings[0]) ? spellings[op] : "?";
+}
+
+namespace {
+
+const char *typeName(uint8_t type) {
+    static const char *const names[] = {"int", "float", "string", "bool"};
+    return type < AstTypeClass ? names[type] : nullptr;
+}
+
+class Dumper {
+public:
+    Dumper(const Ast &ast, const SymbolTable &symbols, std::ostream &out) : ast(ast), symbols(symbols), out(out) {}
+
+    // Works off a stack of its own, since trees can be nested far deeper than
+    // the native stack would allow
+    void run(NodeId root) {
+        child(root, 0);
+        while (!pending.empty()) {
+            Pending next = pending.back();
+            pending.pop_back();
+            size_t mark = pending.size();
+            node(next.id, next.depth);
+            // Children were queued in order, but the first has to come off first
+            std::reverse(pending.begin() + mark, pending.end());
+        }
+    }
+
+private:
+    struct Pending
+    {
+        NodeId id;
+        unsigned depth;
+    };
+
+    const Ast &ast;
+    const SymbolTable &symbols;
+    std::ostream &out;
+    std::vector<Pending> pending;
+
+    // Prints the line for id and queues its children
+    void node(NodeId id, unsigned depth) {
+        const AstNode &node = ast.node(id);
+        out << std::string(depth * 2, ' ') << astKindName(node.kind);
+
+        switch (node.kind) {
+        case AstFunction:
+            out << ' ' << symbols.name(node.a) << '\n';
+            children(ast.functionParameters(id), depth + 1);
+            child(ast.functionBody(id), depth + 1);
+            return;
+        case AstParameter:
+            out << ' ' << type(node.op, node.b) << ' ' << symbols.name(node.a) << '\n';
+            return;
+        case AstClass:
+            out << ' ' << symbols.name(node.a) << " (" << symbols.name(ast.classBase(id)) << ")\n";
+            children(ast.classMembers(id), depth + 1);
+            return;
+        case AstVariable:
+            out << (node.flags & AstPrivate ? " private " : " ") << type(node.op, ast.variableClass(id)) << ' '
+                << symbols.name(node.a) << '\n';
+            child(ast.variableInitializer(id), depth + 1);
+            return;
+        case AstIf:
+            out << '\n';
+            child(node.a, depth + 1);
+            child(ast.ifThen(id), depth + 1);
+            child(ast.ifElse(id), depth + 1);
+            return;
+        case AstFor:
+            out << '\n';
+            child(ast.forInitializer(id), depth + 1);
+            child(ast.forCondition(id), depth + 1);
+            child(ast.forStep(id), depth + 1);
+            child(ast.forBody(id), depth + 1);
+            return;
+        case AstInt:
+            out << ' ' << ast.intValue(id) << '\n';
+            return;
+        case AstFloat:
+            out << ' ' << ast.floatValue(id) << '\n';
+            return;
+        case AstString:
+            out << " '" << symbols.name(node.a) << "'\n";
+            return;
+        case AstBool:
+            out << (node.op ? " true\n" : " false\n");
+            return;
+        case AstName:
+        case AstImport:
+            out << ' ' << symbols.name(node.a) << '\n';
+            return;
+        case AstAssign:
+            out << ' ' << symbols.name(node.a) << '\n';
+            child(node.b, depth + 1);
+            return;
+        case AstCall:
+            out << ' ' << symbols.name(node.a) << '\n';
+            children(ast.callArguments(id), depth + 1);
+            return;
+        case AstBinary:
+            out << ' ' << astOperatorSpelling(static_cast<AstOperator>(node.op)) << '\n';
+            child(node.a, depth + 1);
+            child(node.b, depth + 1);
+            return;
+        case AstProgram:
+        case AstBlock:
+        case AstArray:
+            out << '\n';
+            children(ast.items(id), depth + 1);
+            return;
+        case AstWhile:
+            out << '\n';
+            child(node.a, depth + 1);
+            child(node.b, depth + 1);
+            return;
+        case AstLazyBody:
+            out << " tokens " << node.a << ".." << node.b << '\n';
+            return;
+        default: // A single child in a
+            out << '\n';
+            child(node.a, depth + 1);
+            return;
+        }
+    }
+
+    void child(NodeId id, unsigned depth) {
+        if (id != NoNode) {
+            pending.push_back({id, depth});
+        }
+    }
+
+    void children(NodeRange range, unsigned depth) {
+        for (NodeId id : range) {
+            child(id, depth);
+        }
+    }
+
+    std::string type(uint8_t type, Atom className) {
+        const char *name = typeName(type);
+        return name != nullptr ? name : std::string(symbols.name(className));
+    }
+};
+
+} // namespace
+
+void dumpAst(const Ast &ast, const SymbolTable &symbols, std::ostream &out) {
+    Dumper(ast, symbols, out).run(ast.root());
+}
@@ -0,0 +1,704 @@
+#include "bytecode.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+const unsigned operandCounts[OpcodeCount] = {
+#define MYN_OPCODE_OPERANDS(name, operands, effect) operands,
+    MYN_OPCODES(MYN_OPCODE_OPERANDS)
+#undef MYN_OPCODE_OPERANDS
+};
+
+const int stackEffects[OpcodeCount] = {
+#define MYN_OPCODE_EFFECT(name, operands, effect) effect,
+    MYN_OPCODES(MYN_OPCODE_EFFECT)
+#undef MYN_OPCODE_EFFECT
+};
+
+// Work left for the statement compiler. Like the parser, it runs off a stack
+// of its own, so blocks can nest as deep as the parser allows.
+enum TaskKind : uint8_t
+{
+    TaskStatement, // a: node
+    TaskEndScope,  // a: locals to keep
+    TaskElse,      // Jumps over the else block and lands the condition's jump
+    TaskPatch,     // Lands the jump on top of the patch stack here
+    TaskLoop,      // a: loop start
+    TaskForStep    // a: step expression, b: loop start
+};
+
+struct Task
+{
+    TaskKind kind;
+    uint32_t a;
+    uint32_t b;
+};
+
+// What the compiler knows about a value's type. Declared types are enforced
+// where a value is stored, so a variable's type can be trusted when it is read.
+enum StaticType : uint8_t
+{
+    TypeUnknown, // Checked at run time, as are class types
+    TypeInt,
+    TypeFloat,
+    TypeString,
+    TypeBool
+};
+
+StaticType declaredType(uint8_t type) {
+    switch (type) {
+    case AstTypeInt:
+        return TypeInt;
+    case AstTypeFloat:
+        return TypeFloat;
+    case AstTypeString:
+        return TypeString;
+    case AstTypeBool:
+        return TypeBool;
+    default:
+        return TypeUnknown;
+    }
+}
+
+const char *staticTypeName(StaticType type) {
+    static const char *const names[] = {"a value", "int", "float", "string", "bool"};
+    return names[type];
+}
+
+ValueType valueType(StaticType type) {
+    static const ValueType types[] = {ValueNull, ValueInt, ValueFloat, ValueString, ValueBool};
+    return types[type];
+}
+
+bool isNumeric(StaticType type) {
+    return type == TypeInt || type == TypeFloat;
+}
+
+struct Local
+{
+    Atom name;
+    uint32_t depth;
+    StaticType type;
+};
+
+class Compiler {
+public:
+    Compiler(const Ast &ast, const SymbolTable &symbols, const LineIndex &lines, Bytecode &out, Diagnostics &errors,
+             bool checked)
+        : ast(ast), symbols(symbols), lines(lines), out(out), errors(errors), checked(checked),
+          globals(symbols.size(), 0), functions(symbols.size(), 0), strings(symbols.size(), 0) {}
+
+    void run() {
+        declare();
+
+        // The top level runs as function 0
+        begin(0);
+        NodeRange items = ast.items(ast.root());
+        for (const NodeId *item = items.end(); item != items.begin();) {
+            --item;
+            AstKind kind = ast.kind(*item);
+            if (kind != AstFunction && kind != AstClass && kind != AstImport) {
+                tasks.push_back({TaskStatement, *item, 0});
+            }
+        }
+        drain();
+        end(0);
+
+        for (uint32_t index = 1; index < out.functions.size(); ++index) {
+            NodeId function = declarations[index];
+            begin(index);
+            // Arguments of unknown type are checked once, on the way in
+            for (NodeId parameter : ast.functionParameters(function)) {
+                const AstNode &node = ast.node(parameter);
+                StaticType type = declaredType(node.op);
+                uint32_t slot = declareLocal(parameter, node.a, type);
+                if (type != TypeUnknown) {
+                    offset = node.offset;
+                    emit(OpCheckLocal, slot, valueType(type));
+                }
+            }
+            tasks.push_back({TaskStatement, ast.functionBody(function), 0});
+            drain();
+            end(index);
+        }
+    }
+
+private:
+    const Ast &ast;
+    const SymbolTable &symbols;
+    const LineIndex &lines;
+    Bytecode &out;
+    Diagnostics &errors;
+    // The tree is a rewrite of one that compiled cleanly. A type the rewrite
+    // made known, such as that of an inlined call, was only checked at run
+    // time before, so a mismatch stays a run-time check rather than an error.
+    bool checked;
+
+    // Indexed by atom, 1 + the slot or function index, 0 for none
+    std::vector<uint32_t> globals;
+    std::vector<StaticType> globalTypes; // By slot
+    std::vector<uint32_t> functions;
+    std::vector<NodeId> declarations; // Of each function, by index
+
+    // Constants are shared by every use of the same value
+    std::unordered_map<int64_t, uint32_t> ints;
+    std::unordered_map<uint64_t, uint32_t> floats;
+    std::vector<uint32_t> strings; // By atom, 1 + the constant
+
+    // The function being compiled
+    std::vector<Local> locals; // Innermost last; the index is the slot
+    uint32_t scopeDepth = 0;   // 0 only at the top level, where variables are global
+    uint32_t frameSize = 0;
+    int depth = 0; // Operand stack
+    int maxDepth = 0;
+    uint32_t offset = 0; // Of the node being compiled, for the line table
+
+    std::vector<Task> tasks;
+    std::vector<uint32_t> patches;    // Code words of jumps still to be landed
+    std::vector<std::pair<NodeId, uint8_t>> shortCircuit; // Left operands of && and || with the operator
+    std::vector<uint32_t> shortJumps;
+    std::vector<StaticType> types; // Of the values on the operand stack
+
+    void error(uint32_t at, const std::string &message) { errors.error(lines.locate(at), message); }
+    std::string name(Atom atom) const { return std::string(symbols.name(atom)); }
+
+    // Functions and globals can be used anywhere in the program, including
+    // before their declaration
+    void declare() {
+        out.functions.push_back(BytecodeFunction{NoAtom, 0, 0, 0, 0});
+        declarations.push_back(NoNode);
+        for (NodeId item : ast.items(ast.root())) {
+            const AstNode &node = ast.node(item);
+            if (node.kind == AstFunction) {
+                if (functions[node.a] != 0) {
+                    error(node.offset, "function " + name(node.a) + " is already defined");
+                    continue;
+                }
+                uint32_t arity = static_cast<uint32_t>(ast.functionParameters(item).size());
+                out.functions.push_back(BytecodeFunction{node.a, 0, arity, 0, 0});
+                declarations.push_back(item);
+                functions[node.a] = static_cast<uint32_t>(out.functions.size());
+            } else if (node.kind == AstVariable) {
+                global(node);
+            }
+        }
+    }
+
+    // A global starts out as the zero of its type, since a function may read
+    // it before its declaration runs. Declared twice with different types, it
+    // can hold either.
+    void global(const AstNode &node) {
+        StaticType type = declaredType(node.op);
+        if (globals[node.a] == 0) {
+            globalTypes.push_back(type);
+            out.globals.push_back(zero(type));
+            globals[node.a] = static_cast<uint32_t>(out.globals.size());
+        } else if (globalTypes[globals[node.a] - 1] != type) {
+            globalTypes[globals[node.a] - 1] = TypeUnknown;
+            out.globals[globals[node.a] - 1] = Value::null();
+        }
+    }
+
+    Value zero(StaticType type) {
+        switch (type) {
+        case TypeInt:
+            return Value::integer(0);
+        case TypeFloat:
+            return Value::number(0);
+        case TypeString:
+            return out.heap.string(std::string());
+        case TypeBool:
+            return Value::boolean(false);
+        default:
+            return Value::null();
+        }
+    }
+
+    void begin(uint32_t function) {
+        out.functions[function].entry = static_cast<uint32_t>(out.code.size());
+        locals.clear();
+        scopeDepth = function == 0 ? 0 : 1;
+        frameSize = 0;
+        depth = 0;
+        maxDepth = 0;
+    }
+
+    // Falling off the end returns NULL
+    void end(uint32_t function) {
+        emit(OpNull);
+        emit(OpReturn);
+        out.functions[function].frameSize = frameSize;
+        out.functions[function].maxStack = static_cast<uint32_t>(maxDepth);
+    }
+
+    void emit(Opcode op) {
+        out.code.push_back(op);
+        out.offsets.push_back(offset);
+        adjust(stackEffects[op]);
+    }
+
+    void emit(Opcode op, uint32_t operand) {
+        emit(op);
+        out.code.push_back(operand);
+        out.offsets.push_back(offset);
+    }
+
+    void emit(Opcode op, uint32_t first, uint32_t second) {
+        emit(op, first);
+        out.code.push_back(second);
+        out.offsets.push_back(offset);
+    }
+
+    void adjust(int effect) {
+        depth += effect;
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    // Emits a jump whose target is not known yet and returns the word to patch
+    uint32_t emitJump(Opcode op) {
+        emit(op, 0);
+        return static_cast<uint32_t>(out.code.size() - 1);
+    }
+
+    void land(uint32_t jump) { out.code[jump] = static_cast<uint32_t>(out.code.size()); }
+
+    void landPatch() {
+        land(patches.back());
+        patches.pop_back();
+    }
+
+    void drain() {
+        while (!tasks.empty()) {
+            Task task = tasks.back();
+            tasks.pop_back();
+            switch (task.kind) {
+            case TaskStatement:
+                statement(task.a);
+                break;
+            case TaskEndScope:
+                locals.resize(task.a);
+                --scopeDepth;
+                break;
+            case TaskElse: {
+                uint32_t jump = emitJump(OpJump);
+                landPatch();
+                patches.push_back(jump);
+                break;
+            }
+            case TaskPatch:
+                landPatch();
+                break;
+            case TaskLoop:
+                emit(OpJump, task.a);
+                landPatch();
+                break;
+            case TaskForStep:
+                expression(task.a);
+                emit(OpPop);
+                emit(OpJump, task.b);
+                landPatch();
+                break;
+            }
+        }
+    }
+
+    // Compiles a simple statement right away; a compound one queues its parts
+    void statement(NodeId id) {
+        const AstNode &node = ast.node(id);
+        offset = node.offset;
+        switch (node.kind) {
+        case AstBlock: {
+            NodeRange items = ast.items(id);
+            ++scopeDepth;
+            tasks.push_back({TaskEndScope, static_cast<uint32_t>(locals.size()), 0});
+            for (const NodeId *item = items.end(); item != items.begin();) {
+                tasks.push_back({TaskStatement, *--item, 0});
+            }
+            break;
+        }
+        case AstExpressionStatement:
+            expression(node.a);
+            emit(OpPop);
+            break;
+        case AstVariable:
+            variable(id);
+            break;
+        case AstIf:
+            expression(node.a);
+            patches.push_back(emitJump(OpJumpIfFalse));
+            tasks.push_back({TaskPatch, 0, 0});
+            if (ast.ifElse(id) != NoNode) {
+                tasks.push_back({TaskStatement, ast.ifElse(id), 0});
+                tasks.push_back({TaskElse, 0, 0});
+            }
+            tasks.push_back({TaskStatement, ast.ifThen(id), 0});
+            break;
+        case AstWhile: {
+            uint32_t start = static_cast<uint32_t>(out.code.size());
+            expression(node.a);
+            patches.push_back(emitJump(OpJumpIfFalse));
+            tasks.push_back({TaskLoop, start, 0});
+            tasks.push_back({TaskStatement, node.b, 0});
+            break;
+        }
+        case AstFor: {
+            // The initializer's variable belongs to the loop
+            ++scopeDepth;
+            tasks.push_back({TaskEndScope, static_cast<uint32_t>(locals.size()), 0});
+            statement(ast.forInitializer(id));
+            uint32_t start = static_cast<uint32_t>(out.code.size());
+            expression(ast.forCondition(id));
+            patches.push_back(emitJump(OpJumpIfFalse));
+            tasks.push_back({TaskForStep, ast.forStep(id), start});
+            tasks.push_back({TaskStatement, ast.forBody(id), 0});
+            break;
+        }
+        case AstReturn:
+            expression(node.a);
+            emit(OpReturn);
+            break;
+        case AstOutput:
+            expression(node.a);
+            emit(OpOutput);
+            break;
+        case AstLazyBody:
+            error(node.offset, "function body was not parsed");
+            break;
+        default:
+            // Classes have nothing to run until objects can be made
+            break;
+        }
+    }
+
+    void variable(NodeId id) {
+        const AstNode &node = ast.node(id);
+        NodeId initializer = ast.variableInitializer(id);
+        StaticType type = declaredType(node.op);
+        StaticType value = TypeUnknown;
+        if (initializer != NoNode) {
+            value = expression(initializer);
+        } else {
+            emit(OpNull);
+        }
+        // Declared after the initializer, which still sees any outer variable
+        offset = node.offset;
+        if (scopeDepth == 0) {
+            uint32_t slot = globals[node.a] - 1;
+            coerce(value, globalTypes[slot], node.a);
+            emit(OpStoreGlobal, slot);
+        } else {
+            coerce(value, type, node.a);
+            emit(OpStoreLocal, declareLocal(id, node.a, type));
+        }
+        emit(OpPop);
+    }
+
+    // Makes the value on top, of type actual, fit a variable of type wanted
+    void coerce(StaticType actual, StaticType wanted, Atom variable) {
+        if (wanted == TypeUnknown || actual == wanted) {
+            return;
+        }
+        if (wanted == TypeFloat && actual == TypeInt) {
+            emit(OpIntToFloat);
+        } else if (actual == TypeUnknown || checked) {
+            emit(OpCheck, valueType(wanted));
+        } else {
+            error(offset, std::string("cannot assign ") + staticTypeName(actual) + " to " + staticTypeName(wanted) +
+                              ' ' + name(variable));
+        }
+    }
+
+    uint32_t declareLocal(NodeId id, Atom atom, StaticType type) {
+        for (size_t i = locals.size(); i-- > 0 && locals[i].depth == scopeDepth;) {
+            if (locals[i].name == atom) {
+                error(ast.node(id).offset, name(atom) + " is already declared in this block");
+                break;
+            }
+        }
+        locals.push_back({atom, scopeDepth, type});
+        frameSize = std::max(frameSize, static_cast<uint32_t>(locals.size()));
+        return static_cast<uint32_t>(locals.size() - 1);
+    }
+
+    // Emits a load or, with store set, a store of the variable called atom.
+    // Returns the variable's type.
+    StaticType variableAccess(const AstNode &node, Atom atom, bool store) {
+        for (size_t i = locals.size(); i-- > 0;) {
+            if (locals[i].name == atom) {
+                if (store) {
+                    coerce(types.back(), locals[i].type, atom);
+                }
+                emit(store ? OpStoreLocal : OpLoadLocal, static_cast<uint32_t>(i));
+                return locals[i].type;
+            }
+        }
+        if (globals[atom] != 0) {
+            uint32_t slot = globals[atom] - 1;
+            if (store) {
+                coerce(types.back(), globalTypes[slot], atom);
+            }
+            emit(store ? OpStoreGlobal : OpLoadGlobal, slot);
+            return globalTypes[slot];
+        }
+        error(node.offset, "unknown variable " + name(atom));
+        if (!store) {
+            emit(OpNull);
+        }
+        return TypeUnknown;
+    }
+
+    // An expression is a post-order run of nodes, which is the order a stack
+    // machine evaluates it in, so it compiles front to back without recursion.
+    // Only && and || need to know where their left operand ends. The types of
+    // the operands are tracked alongside; returns the type of the result.
+    StaticType expression(NodeId root) {
+        const NodeId first = ast.firstNode(root);
+        shortCircuit.clear();
+        for (NodeId id = first; id <= root; ++id) {
+            const AstNode &node = ast.node(id);
+            if (node.kind == AstBinary && (node.op == AstAnd || node.op == AstOr)) {
+                shortCircuit.push_back({node.a, node.op});
+            }
+        }
+        std::sort(shortCircuit.begin(), shortCircuit.end());
+        auto nextLeft = shortCircuit.begin();
+
+        for (NodeId id = first; id <= root; ++id) {
+            const AstNode &node = ast.node(id);
+            offset = node.offset;
+            operation(id, node);
+            if (nextLeft != shortCircuit.end() && nextLeft->first == id) {
+                // The operator is the innermost one still open when it is
+                // reached, so the jumps land in reverse order
+                shortJumps.push_back(emitJump(nextLeft->second == AstAnd ? OpJumpIfFalse : OpJumpIfTrue));
+                types.pop_back();
+                ++nextLeft;
+            }
+        }
+        StaticType type = types.back();
+        types.pop_back();
+        return type;
+    }
+
+    void operation(NodeId id, const AstNode &node) {
+        switch (node.kind) {
+        case AstInt:
+            constant(ints, ast.intValue(id), [&] { return Value::integer(ast.intValue(id)); });
+            types.push_back(TypeInt);
+            break;
+        case AstFloat: {
+            uint64_t bits = static_cast<uint64_t>(node.b) << 32 | node.a;
+            constant(floats, bits, [&] { return Value::number(ast.floatValue(id)); });
+            types.push_back(TypeFloat);
+            break;
+        }
+        case AstString:
+            if (strings[node.a] == 0) {
+                out.constants.push_back(out.heap.string(std::string(symbols.name(node.a))));
+                strings[node.a] = static_cast<uint32_t>(out.constants.size());
+            }
+            emit(OpConstant, strings[node.a] - 1);
+            types.push_back(TypeString);
+            break;
+        case AstBool:
+            emit(node.op ? OpTrue : OpFalse);
+            types.push_back(TypeBool);
+            break;
+        case AstNull:
+            emit(OpNull);
+            types.push_back(TypeUnknown);
+            break;
+        case AstName:
+            types.push_back(variableAccess(node, node.a, false));
+            break;
+        case AstAssign: {
+            StaticType type = variableAccess(node, node.a, true);
+            if (type != TypeUnknown) {
+                types.back() = type;
+            }
+            break;
+        }
+        case AstCall:
+            call(id, node);
+            break;
+        case AstArray:
+            emit(OpArray, node.b);
+            adjust(-static_cast<int>(node.b));
+            types.resize(types.size() - node.b);
+            types.push_back(TypeUnknown);
+            break;
+        case AstBinary:
+            binary(node);
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <typename Key, typename Make>
+    void constant(std::unordered_map<Key, uint32_t> &pool, Key key, Make make) {
+        auto found = pool.find(key);
+        if (found == pool.end()) {
+            found = pool.emplace(key, static_cast<uint32_t>(out.constants.size())).first;
+            out.constants.push_back(make());
+        }
+        emit(OpConstant, found->second);
+    }
+
+    void call(NodeId id, const AstNode &node) {
+        const int count = static_cast<int>(ast.callArguments(id).size());
+        uint32_t index = functions[node.a];
+        if (index == 0) {
+            error(node.offset, "unknown function " + name(node.a));
+        } else if (out.functions[index - 1].arity != static_cast<uint32_t>(count)) {
+            error(node.offset, name(node.a) + " takes " + std::to_string(out.functions[index - 1].arity) +
+                                   " arguments, not " + std::to_string(count));
+        } else {
+            // Arguments of unknown type are left to the callee's check
+            NodeRange parameters = ast.functionParameters(declarations[index - 1]);
+            const StaticType *arguments = types.data() + types.size() - count;
+            for (int i = 0; i < count; ++i) {
+                const AstNode &parameter = ast.node(parameters.begin()[i]);
+                StaticType wanted = declaredType(parameter.op);
+                StaticType actual = arguments[i];
+                if (!checked && wanted != TypeUnknown && actual != TypeUnknown && actual != wanted &&
+                    !(wanted == TypeFloat && actual == TypeInt)) {
+                    error(node.offset, "argument " + name(parameter.a) + " of " + name(node.a) + " must be " +
+                                           staticTypeName(wanted) + ", not " + staticTypeName(actual));
+                }
+            }
+        }
+        emit(OpCall, index == 0 ? 0 : index - 1);
+        adjust(-count);
+        types.resize(types.size() - count);
+        types.push_back(TypeUnknown);
+    }
+
+    void binary(const AstNode &node) {
+        if (node.op != AstAnd && node.op != AstOr) {
+            StaticType right = types.back();
+            types.pop_back();
+            StaticType left = types.back();
+            types.back() = arithmetic(static_cast<AstOperator>(node.op), left, right, node.offset);
+            return;
+        }
+
+        // The right operand decides; a left one that did goes straight to the
+        // constant it implies
+        emit(OpToBool);
+        uint32_t done = emitJump(OpJump);
+        land(shortJumps.back());
+        shortJumps.pop_back();
+        adjust(-1);
+        emit(node.op == AstAnd ? OpFalse : OpTrue);
+        land(done);
+        types.back() = TypeBool;
+    }
+
+    // Emits the instruction for left op right and returns the type of the
+    // result. Operands of known numeric types get an instruction for just
+    // those types, with ints converted where they meet a float; the others
+    // go through the generic one, which looks at the values.
+    StaticType arithmetic(AstOperator op, StaticType left, StaticType right, uint32_t at) {
+        static const Opcode generic[] = {OpAdd,  OpSubtract, OpMultiply,  OpDivide,      OpEqual,
+                                         OpNotEqual, OpLess, OpGreater, OpLessEqual, OpGreaterEqual};
+        static const Opcode intOps[] = {OpIntAdd,  OpIntSubtract, OpIntMultiply,  OpIntDivide,      OpIntEqual,
+                                      OpIntNotEqual, OpIntLess, OpIntGreater, OpIntLessEqual, OpIntGreaterEqual};
+        static const Opcode floatOps[] = {OpFloatAdd,     OpFloatSubtract, OpFloatMultiply, OpFloatDivide,
+                                        OpFloatEqual,   OpFloatNotEqual, OpFloatLess,     OpFloatGreater,
+                                        OpFloatLessEqual, OpFloatGreaterEqual};
+        const bool comparison = op >= AstEqual;
+        const StaticType result = comparison ? TypeBool : left == TypeInt && right == TypeInt ? TypeInt : TypeFloat;
+
+        if (left == TypeInt && right == TypeInt) {
+            emit(intOps[op]);
+            return result;
+        }
+        if (isNumeric(left) && isNumeric(right)) {
+            if (left == TypeInt) {
+                emit(OpIntToFloatBelow);
+            } else if (right == TypeInt) {
+                emit(OpIntToFloat);
+            }
+            emit(floatOps[op]);
+            return result;
+        }
+
+        emit(generic[op]);
+        if (op == AstEqual || op == AstNotEqual) {
+            return TypeBool;
+        }
+        if (op == AstAdd && (left == TypeString || right == TypeString)) {
+            return TypeString; // Anything joins a string
+        }
+        // Operands that would fail every time are caught here
+        if (!checked && left != TypeUnknown && right != TypeUnknown) {
+            static const char *const verbs[] = {"add", "subtract", "multiply", "divide", "", "",
+                                                "compare", "compare", "compare", "compare"};
+            if (!(comparison && left == TypeString && right == TypeString)) {
+                error(at, std::string("cannot ") + verbs[op] + ' ' + staticTypeName(left) + " and " +
+                              staticTypeName(right));
+            }
+        }
+        return comparison ? TypeBool : TypeUnknown;
+    }
+};
+
+} // namespace
+
+const char *opcodeName(Opcode op) {
+    static const char *const names[OpcodeCount] = {
+#define MYN_OPCODE_NAME(name, operands, effect) #name,
+        MYN_OPCODES(MYN_OPCODE_NAME)
+#undef MYN_OPCODE_NAME
+    };
+    return op < OpcodeCount ? names[op] : "?";
+}
+
+unsigned opcodeOperands(Opcode op) {
+    return op < OpcodeCount ? operandCounts[op] : 0;
+}
+
+void compileProgram(const Ast &ast, const SymbolTable &symbols, const LineIndex &lines, Bytecode &out,
+                    Diagnostics &errors, bool checked) {
+    Compiler(ast, symbols, lines, out, errors, checked).run();
+}
+
+void dumpBytecode(const Bytecode &program, const SymbolTable &symbols, std::ostream &out) {
+    for (size_t index = 0; index < program.functions.size(); ++index) {
+        const BytecodeFunction &function = program.functions[index];
+        size_t end = index + 1 < program.functions.size() ? program.functions[index + 1].entry : program.code.size();
+        out << "function " << (function.name == NoAtom ? std::string_view("<top level>") : symbols.name(function.name))
+            << " (" << function.arity << " parameters, " << function.frameSize << " locals, stack "
+            << function.maxStack << ")\n";
+
+        std::string line;
+        for (size_t pc = function.entry; pc < end; pc += 1 + opcodeOperands(static_cast<Opcode>(program.code[pc]))) {
+            Opcode op = static_cast<Opcode>(program.code[pc]);
+            char address[32]; // Room for a 20 digit pc
+            std::snprintf(address, sizeof(address), "  %04zu ", pc);
+            line = address;
+            line += opcodeName(op);
+            for (unsigned i = 1; i <= opcodeOperands(op); ++i) {
+                line += ' ';
+                line += std::to_string(program.code[pc + i]);
+            }
+            if (opcodeOperands(op) != 0) {
+                uint32_t operand = program.code[pc + 1];
+                if (op == OpConstant) {
+                    line += " (";
+                    appendValue(line, program.constants[operand]);
+                    line += ')';
+                } else if (op == OpCall) {
+                    line += " (";
+                    line += symbols.name(program.functions[operand].name);
+                    line += ')';
+                }
+            }
+            out << line << '\n';
+        }
+    }
+}
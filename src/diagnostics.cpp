@@ -0,0 +1,28 @@
+#include "diagnostics.hpp"
+
+void Diagnostics::error(SourceLocation location, std::string message) {
+    entries.push_back(Diagnostic{location, std::move(message)});
+}
+
+void Diagnostics::print(std::ostream &out, std::string_view filename) const {
+    if (entries.empty()) {
+        return;
+    }
+
+    std::string text;
+    for (const Diagnostic &diagnostic : entries) {
+        text.append(filename.data(), filename.size());
+        text += ':';
+        text += std::to_string(diagnostic.location.line);
+        text += ':';
+        text += std::to_string(diagnostic.location.column);
+        text += ": error: ";
+        text += diagnostic.message;
+        text += '\n';
+    }
+    text += std::to_string(entries.size());
+    text += entries.size() == 1 ? " error\n" : " errors\n";
+
+    out.write(text.data(), text.size());
+    out.flush();
+}
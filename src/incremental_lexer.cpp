@@ -0,0 +1,68 @@
+#include "lexer.hpp"
+#include <cassert>
+
+namespace {
+
+// Index of the first token that ends at or after offset
+size_t firstEndingAt(const TokenBuffer &tokens, size_t offset) {
+    size_t low = 0;
+    size_t high = tokens.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (tokens.end(middle) < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+} // namespace
+
+TokenSplice relex(TokenBuffer &tokens, std::string_view newSource, const TextEdit &edit, SymbolTable &symbols,
+                  const LexerContext &context) {
+    [[maybe_unused]] const size_t oldSize = tokens.source().size();
+    assert(edit.offset + edit.removed <= oldSize);
+    assert(newSource.size() == oldSize - edit.removed + edit.inserted.size());
+    assert(newSource.substr(edit.offset, edit.inserted.size()) == edit.inserted);
+
+    const int64_t shift = static_cast<int64_t>(edit.inserted.size()) - static_cast<int64_t>(edit.removed);
+    const size_t editEnd = edit.offset + edit.inserted.size(); // In the new source
+
+    // Whether a token ends is decided by the byte after it, so a token is
+    // only safe if that byte comes before the edit too
+    size_t first = firstEndingAt(tokens, edit.offset);
+    size_t restart = first == 0 ? 0 : tokens.end(first - 1);
+
+    Lexer lexer(newSource, symbols, context);
+    lexer.seek(restart);
+
+    // Lex until a token ends where an old one did, past the edit. The lexer
+    // is then in the same state as it was on the old source, and the text
+    // that follows is the same, so the old tokens from there on still hold.
+    TokenBuffer fresh(newSource);
+    size_t old = first;
+    size_t resync = tokens.size();
+    Token token;
+    while (lexer.next(token)) {
+        fresh.push(token);
+
+        size_t end = token.value.data() + token.value.size() - newSource.data();
+        if (end < editEnd) {
+            continue;
+        }
+        size_t oldEnd = static_cast<size_t>(end - shift);
+        while (old < tokens.size() && tokens.end(old) < oldEnd) {
+            ++old;
+        }
+        if (old < tokens.size() && tokens.end(old) == oldEnd) {
+            resync = old + 1;
+            break;
+        }
+    }
+
+    TokenSplice splice = {first, resync - first, fresh.size()};
+    tokens.splice(first, resync - first, fresh, shift);
+    return splice;
+}
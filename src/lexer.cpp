@@ -1,4 +1,5 @@
 #include "lexer.hpp"
+#include "scan.hpp"
 #include <iostream>
 #include <sstream>
 #include <cstring>
@@ -8,87 +9,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cctype>
-#include <set>
-
-typedef std::map<std::string, TokenType> ReservedIdentMap;
-
-// Reserved identifiers map
-ReservedIdentMap reservedIdent;
-
-void INIT_RESERVED_IDENTIFIER()
-{
-    reservedIdent["myn"] = TokenType::Myn;
-    reservedIdent["for"] = TokenType::For;
-    reservedIdent["while"] = TokenType::While;
-    reservedIdent["switch"] = TokenType::Switch;
-    reservedIdent["fun"] = TokenType::Fun;
-    reservedIdent["class"] = TokenType::Class;
-    reservedIdent["break"] = TokenType::Break;
-    reservedIdent["case"] = TokenType::Case;
-    reservedIdent["True"] = TokenType::True;
-    reservedIdent["False"] = TokenType::False;
-    reservedIdent["public"] = TokenType::Public;
-    reservedIdent["enum"] = TokenType::Enum;
-    reservedIdent["private"] = TokenType::Private;
-    reservedIdent["protected"] = TokenType::Protected;
-    reservedIdent["void"] = TokenType::Void;
-    reservedIdent["this"] = TokenType::This;
-    reservedIdent["throw"] = TokenType::Throw;
-    reservedIdent["try"] = TokenType::Try;
-    reservedIdent["catch"] = TokenType::Catch;
-    reservedIdent["import"] = TokenType::Import;
-    reservedIdent["continue"] = TokenType::Continue;
-    reservedIdent["pass"] = TokenType::Pass;
-    reservedIdent["NULL"] = TokenType::Null;
-    reservedIdent["elif"] = TokenType::Elif;
-    reservedIdent["else"] = TokenType::Else;
-    reservedIdent["if"] = TokenType::If;
-    reservedIdent["static"] = TokenType::Static;
-    reservedIdent["return"] = TokenType::Return;
-    reservedIdent["input"] = TokenType::Input;
-    reservedIdent["output"] = TokenType::Output;
-
-    // Add data types
-    reservedIdent["int"] = TokenType::IntType;
-    reservedIdent["float"] = TokenType::FloatType;
-    reservedIdent["string"] = TokenType::StringType;
-    reservedIdent["bool"] = TokenType::BooleanType;
-}
-
-std::unordered_set<std::string> defaultReservedKeywords = {
-    "fun", "for", "while", "switch", "class", "break", "case", "true", "false",
-    "public", "enum", "private", "protected", "void", "this", "throw", "try", "catch",
-    "import", "continue", "pass", "NULL", "elif", "else", "if", "static", "return",
-    "input", "output", "int", "float", "string", "bool"};
-
-std::unordered_set<std::string> reservedKeywords = {
-    "myn", "for", "while", "switch", "fun", "class", "break", "case", "True", "False",
-    "public", "enum", "private", "protected", "void", "this", "throw", "try", "catch",
-    "import", "continue", "pass", "NULL", "elif", "else", "if", "static", "return",
-    "input", "output", "int", "float", "string", "bool"};
-
-void updateReservedKeywords(const std::unordered_map<std::string, std::string> &config)
-{
-    reservedKeywords.clear(); // Clear the existing reserved keywords
-    for (const auto &entry : config)
-    {
-        reservedKeywords.insert(entry.second); // Add the new keywords to the reserved keywords set
-    }
-    // Add the default reserved keywords to the set, but only if they are not overridden
-    for (const auto &keyword : defaultReservedKeywords)
-    {
-        if (config.count(keyword) == 0)
-        { // Check if the keyword is not overridden
-            reservedKeywords.insert(keyword);
-        }
-    }
-}
-std::set<std::pair<std::string, std::string>> classChildRelations;
-
-void addClassChildRelation(const std::string &parent, const std::string &child)
-{
-    classChildRelations.insert({parent, child});
-}
+#include <cassert>
 
 std::string shift(std::vector<std::string> &src)
 {
@@ -97,7 +18,12 @@ std::string shift(std::vector<std::string> &src)
     return current;
 }
 
-bool isNumber(const std::string &str)
+bool isReservedKeyword(std::string_view word)
+{
+    return keywordType(word) != TokenType::Identifier;
+}
+
+bool isNumber(std::string_view str)
 {
     bool hasDecimal = false;
     for (char ch : str)
@@ -117,10 +43,11 @@ bool isNumber(const std::string &str)
 }
 
 // Function to classify the token and return its TokenType
-TokenType classifyToken(const std::string &token) {
+TokenType classifyToken(std::string_view token) {
     // Check if the token is a reserved identifier
-    if (reservedIdent.find(token) != reservedIdent.end()) {
-        return reservedIdent[token];
+    TokenType keyword = keywordType(token);
+    if (keyword != TokenType::Identifier) {
+        return keyword;
     }
 
     // Check if the token is an identifier (alphabetic or underscore)
@@ -143,11 +70,11 @@ TokenType classifyToken(const std::string &token) {
             return TokenType::Invalid; // Not a valid number
         }
     }
-    return hasDecimalPoint ? TokenType::FloatType : TokenType::IntNumber; // Determine type based on decimal point
+    return hasDecimalPoint ? TokenType::FloatNumber : TokenType::IntNumber; // Determine type based on decimal point
 }
 
 // Check if the token is an identifier
-bool isAlpha(const std::string &str, TokenType &type) {
+bool isAlpha(std::string_view str, TokenType &type) {
     // Classify the token and assign its TokenType
     type = classifyToken(str);
 
@@ -160,215 +87,290 @@ bool isSkippable(char ch)
     return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
 }
 
-Token token(std::string value, TokenType tokentype)
+Token token(std::string_view value, TokenType tokentype, Atom atom = NoAtom)
+{
+    return {value, tokentype, atom};
+}
+
+// Interns identifiers; other words carry no atom
+static Token wordToken(std::string_view word, TokenType type, SymbolTable &symbols)
 {
-    return {value, tokentype};
+    return token(word, type, type == TokenType::Identifier ? symbols.intern(word) : NoAtom);
 }
 
-std::vector<Token> tokenize(std::string &sourceCode)
+// String literals are interned without their quotes
+static Token stringToken(std::string_view literal, SymbolTable &symbols)
 {
-    std::vector<Token> tokens;
-    std::string buffer;
-    bool inQuote = false;
-    char quoteChar = '\0';
+    return token(literal, TokenType::String, symbols.intern(literal.substr(1, literal.size() - 2)));
+}
 
-    for (size_t i = 0; i < sourceCode.size(); ++i)
+// Classifies a word under the given keyword context. Unlike checkTokenType()
+// this does one keyword lookup and never consults the built-in spellings when
+// the context has remapped them.
+static TokenType classifyWord(std::string_view word, const LexerContext &context)
+{
+    TokenType keyword = context.keyword(word);
+    if (keyword != TokenType::Identifier)
     {
-        char ch = sourceCode[i];
+        return keyword;
+    }
 
-        if (inQuote)
+    unsigned char first = static_cast<unsigned char>(word[0]);
+    if (isalpha(first) || first == '_')
+    {
+        for (char ch : word)
         {
-            buffer += ch;
-            if (ch == quoteChar)
+            if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_')
             {
-                tokens.push_back(token(buffer, TokenType::String));
-                buffer.clear();
-                inQuote = false;
-                quoteChar = '\0';
+                return TokenType::Unknown; // Invalid identifier
             }
         }
-        else
+        return TokenType::Identifier;
+    }
+
+    if (isNumber(word))
+    {
+        return word.find('.') != std::string_view::npos ? TokenType::FloatNumber : TokenType::IntNumber;
+    }
+    return TokenType::Unknown;
+}
+
+Lexer::Lexer(std::string_view sourceCode, SymbolTable &symbols, const LexerContext &context)
+    : source(sourceCode), symbols(symbols), context(context), scan(scanner()), position(0) {}
+
+bool Lexer::next(Token &out)
+{
+    // Every step looks up the class of the current byte and the transition for
+    // it in the context's tables. Runs of whitespace, words, comments and
+    // strings are then consumed in bulk by the scanner.
+    const char *data = source.data();
+    const size_t size = source.size();
+    size_t start = position;
+    size_t i = position;
+    uint8_t state = LexStart;
+
+    for (;;)
+    {
+        uint8_t byteClass = i < size ? context.charClass(data[i]) : static_cast<uint8_t>(LexClassEnd);
+        const LexTransition &transition = context.transition(state, byteClass);
+
+        switch (transition.action)
+        {
+        case LexShift:
+            // Part of a symbol that may continue, e.g. the '/' of "/*"
+            state = transition.next;
+            ++i;
+            break;
+
+        case LexEmit:
+            // The current byte completes the symbol
+            out = token(source.substr(start, i + 1 - start), transition.type);
+            position = i + 1;
+            return true;
+
+        case LexEmitBefore:
+            // The current byte does not belong to the symbol
+            out = token(source.substr(start, i - start), transition.type);
+            position = i;
+            return true;
+
+        case LexSkipSpace:
+            i = scan.space(data, size, i + 1);
+            start = i;
+            break;
+
+        case LexSkipLineComment:
+        {
+            size_t newline = scan.find(data, size, i + 1, '\n');
+            i = newline == size ? size : newline + 1;
+            start = i;
+            state = LexStart;
+            break;
+        }
+
+        case LexSkipBlockComment:
         {
-            if (ch == '\'' || ch == '"')
-            {
-                inQuote = true;
-                quoteChar = ch;
-                if (!buffer.empty())
-                {
-                    TokenType type = checkTokenType(buffer);
-                    tokens.push_back(token(buffer, type));
-                    buffer.clear();
-                }
-                buffer += ch;
-            }
-            else if (isSkippable(ch))
-            {
-                if (!buffer.empty())
-                {
-                    TokenType type = checkTokenType(buffer);
-                    tokens.push_back(token(buffer, type));
-                    buffer.clear();
-                }
-            }
-            else if (ch == '#')
-            {
-                // Handle single-line comment
-                while (i < sourceCode.size() && sourceCode[i] != '\n')
-                {
-                    ++i;
-                }
-            }
-            else if (ch == '/' && i + 1 < sourceCode.size() && sourceCode[i + 1] == '*')
-            {
-                // Handle multi-line comment
-                i += 2;
-                while (i + 1 < sourceCode.size() && !(sourceCode[i] == '*' && sourceCode[i + 1] == '/'))
-                {
-                    ++i;
-                }
-                i += 1; // Skip the closing '*/'
-            }
-            else if (ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == '{' || ch == '}' ||
-                     ch == '+' || ch == '-' || ch == '*' || ch == '/' || ch == '=' || ch == ';' || ch == ',')
-            {
-                if (!buffer.empty())
-                {
-                    TokenType type = checkTokenType(buffer);
-                    tokens.push_back(token(buffer, type));
-                    buffer.clear();
-                }
-
-                TokenType type;
-                switch (ch)
-                {
-                case '(':
-                    type = TokenType::OpenParen;
-                    break;
-                case ')':
-                    type = TokenType::CloseParen;
-                    break;
-                case '[':
-                    type = TokenType::OpenSBracket;
-                    break;
-                case ']':
-                    type = TokenType::CloseSBracket;
-                    break;
-                case '{':
-                    type = TokenType::OpenBrace;
-                    break;
-                case '}':
-                    type = TokenType::CloseBrace;
-                    break;
-                case '+':
-                case '-':
-                case '*':
-                case '/':
-                    type = TokenType::ArithmeticOperator;
-                    break;
-                case '=':
-                    type = TokenType::AssignmentOperator;
-                    break;
-                case ';':
-                    type = TokenType::Semicolon;
-                    break;
-                case ',':
-                    type = TokenType::Comma;
-                    break;
-                }
-                tokens.push_back(token(std::string(1, ch), type));
-            }
-            else
+            // An unterminated comment runs to the end
+            size_t close = scan.commentEnd(data, size, i + 1);
+            i = close == size ? size : close + 2; // Skip the closing '*/'
+            start = i;
+            state = LexStart;
+            break;
+        }
+
+        case LexString:
+        {
+            size_t close = scan.find(data, size, i + 1, data[i]);
+            if (close == size)
             {
-                buffer += ch;
+                // Unterminated string, keep whatever is left as one token
+                std::string_view rest = source.substr(i);
+                out = wordToken(rest, classifyWord(rest, context), symbols);
+                position = size;
+                return true;
             }
+            out = stringToken(source.substr(i, close + 1 - i), symbols);
+            position = close + 1;
+            return true;
+        }
+
+        case LexWord:
+        {
+            size_t end = scan.word(data, size, i + 1);
+            std::string_view word = source.substr(i, end - i);
+            out = wordToken(word, classifyWord(word, context), symbols);
+            position = end;
+            return true;
+        }
+
+        default: // LexStop
+            position = size;
+            return false;
         }
     }
+}
 
-    if (!buffer.empty())
+TokenBuffer tokenize(std::string_view sourceCode, SymbolTable &symbols, const LexerContext &context)
+{
+    TokenBuffer tokens(sourceCode);
+    // A rough guess that avoids most of the regrowth on large inputs
+    tokens.reserve(sourceCode.size() / 4);
+
+    Lexer lexer(sourceCode, symbols, context);
+    Token next;
+    while (lexer.next(next))
     {
-        TokenType type = checkTokenType(buffer);
-        tokens.push_back(token(buffer, type));
+        tokens.push(next);
     }
 
     return tokens;
 }
 
-std::vector<Token> tokenize_with_config(std::string &sourcecode, std::unordered_map<std::string, std::string> &config)
+TokenStream::TokenStream()
+    : lexer(nullptr), tokens(nullptr), index(0), last(0), ownLines(true), head(0), count(0), exhausted(true) {}
+
+TokenStream::TokenStream(Lexer &lexer)
+    : lexer(&lexer), tokens(nullptr), index(0), last(0), lines(lexer.text()), ownLines(true), head(0), count(0),
+      exhausted(false) {}
+
+TokenStream::TokenStream(const TokenBuffer &tokens)
+    : lexer(nullptr), tokens(&tokens), index(0), last(tokens.size()), ownLines(false), head(0), count(0),
+      exhausted(true) {}
+
+TokenStream::TokenStream(const TokenBuffer &tokens, size_t first, size_t last)
+    : lexer(nullptr), tokens(&tokens), index(first), last(last), lines(tokens.source()), ownLines(true), head(0),
+      count(0), exhausted(true)
 {
-    updateReservedKeywords(config); // Update the reservedKeywords set with the new keywords from the config map
-    std::vector<Token> tokens;
-    std::string buffer;
-    bool inQuote = false;
-    char quoteChar = '0';
+    assert(first <= last && last <= tokens.size());
+}
 
-    for (size_t i = 0; i < sourcecode.size(); ++i)
+bool TokenStream::fill(size_t k)
+{
+    while (count <= k && !exhausted)
     {
-        char ch = sourcecode[i];
-        if (ch == '\'' || ch == '"')
+        if (!lexer->next(ring[(head + count) & (Lookahead - 1)]))
         {
-            inQuote = !inQuote; // Toggle inQuote
-            if (inQuote)
-            {
-                quoteChar = ch; // Store quote character
-            }
-            else
-            {
-                buffer += ch;                                       // Close the string
-                tokens.push_back(token(buffer, TokenType::String)); // Assuming you have a String type
-                buffer.clear();
-            }
+            exhausted = true;
+            break;
         }
-        else if (isSkippable(ch))
+        ++count;
+    }
+    return count > k;
+}
+
+const Token &TokenStream::peek(size_t k)
+{
+    static const Token endOfInput = {std::string_view(), TokenType::Invalid, NoAtom};
+
+    assert(k < Lookahead && "lookahead beyond the ring buffer");
+    if (tokens != nullptr)
+    {
+        if (index + k >= last)
         {
-            if (!buffer.empty())
-            {
-                // Handle the buffer before skipping
-                tokens.push_back(token(buffer, TokenType::Identifier)); // Default to identifier
-                buffer.clear();
-            }
+            return endOfInput;
         }
-        else if (ch == '#')
+        // Rebuilt from the arrays; the ring only gives it a stable address
+        Token &slot = ring[k];
+        slot = tokens->token(index + k);
+        return slot;
+    }
+    return fill(k) ? ring[(head + k) & (Lookahead - 1)] : endOfInput;
+}
+
+TokenType TokenStream::type(size_t k)
+{
+    if (tokens != nullptr)
+    {
+        return index + k < last ? tokens->type(index + k) : TokenType::Invalid;
+    }
+    return peek(k).type;
+}
+
+uint32_t TokenStream::offset(size_t k)
+{
+    if (tokens != nullptr)
+    {
+        if (index + k < last)
         {
-            // Handle single-line comment
-            while (i < sourcecode.size() && sourcecode[i] != 'n') // Fixed 'n' character
-            {
-                ++i;
-            }
+            return tokens->offset(index + k);
         }
-        else if (ch == '/' && i + 1 < sourcecode.size() && sourcecode[i + 1] == '*')
-        {
-            // Handle multi-line comment
-            i += 2;
-            while (i + 1 < sourcecode.size() && !(sourcecode[i] == '*' && sourcecode[i + 1] == '/'))
-            {
-                ++i;
-            }
-            i += 1; // Skip the closing '*/'
-        }
-        else if (isSymbol(ch))
-        { 
-            if (!buffer.empty())
-            {
-                tokens.push_back(token(buffer, TokenType::Identifier)); // Default to identifier
-                buffer.clear();
-            }
+        return last < tokens->size() ? tokens->offset(last) : static_cast<uint32_t>(tokens->source().size());
+    }
 
-            // Handle single-character symbols
-            TokenType type = getSymbolTokenType(std::string(1, ch)); // Convert char to std::string
-            tokens.push_back(token(std::string(1, ch), type));
-        }
-        else
+    std::string_view text = lexer->text();
+    size_t offset = fill(k) ? ring[(head + k) & (Lookahead - 1)].value.data() - text.data() : text.size();
+    return static_cast<uint32_t>(offset);
+}
+
+SourceLocation TokenStream::location(size_t k)
+{
+    if (!ownLines)
+    {
+        return tokens->lineIndex().locate(offset(k));
+    }
+    return lines.locate(offset(k));
+}
+
+void TokenStream::advance()
+{
+    if (tokens != nullptr)
+    {
+        if (index < last)
         {
-            buffer += ch;
+            ++index;
         }
     }
+    else if (fill(0))
+    {
+        head = (head + 1) & (Lookahead - 1);
+        --count;
+    }
+}
+
+void TokenStream::seek(size_t index)
+{
+    assert(tokens != nullptr && index <= last);
+    this->index = index;
+}
 
-    if (!buffer.empty())
+bool TokenStream::atEnd()
+{
+    if (tokens != nullptr)
     {
-        tokens.push_back(token(buffer, TokenType::Identifier)); // Default to identifier
+        return index == last;
     }
+    return !fill(0);
+}
 
-    return tokens;
+TokenBuffer tokenize_with_config(std::string_view sourcecode, std::unordered_map<std::string, std::string> &config,
+                                 SymbolTable &symbols)
+{
+    return tokenize(sourcecode, symbols, LexerContext(config));
+}
+
+TokenBuffer tokenize_with_config(std::string_view sourcecode, const LexerContext &context, SymbolTable &symbols)
+{
+    return tokenize(sourcecode, symbols, context);
 }
 
 // Helper function to determine if a character is a symbol
@@ -376,12 +378,13 @@ bool isSymbol(char ch)
 {
     return ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == '{' || ch == '}' ||
            ch == '+' || ch == '-' || ch == '*' || ch == '/' || ch == '=' ||
-           ch == ';' || ch == ',';
+           ch == ';' || ch == ',' || ch == ':' ||
+           ch == '!' || ch == '&' || ch == '|' || ch == '<' || ch == '>';
 }
 
 // Helper function to get the TokenType for symbols
-TokenType getSymbolTokenType(const std::string& symbol) {
-    static const std::unordered_map<std::string, TokenType> tokenMap = {
+TokenType getSymbolTokenType(std::string_view symbol) {
+    static const std::unordered_map<std::string_view, TokenType> tokenMap = {
         {"(", TokenType::OpenParen},
         {")", TokenType::CloseParen},
         {"[", TokenType::OpenSBracket},
@@ -395,6 +398,15 @@ TokenType getSymbolTokenType(const std::string& symbol) {
         {"=", TokenType::AssignmentOperator},
         {";", TokenType::Semicolon},
         {",", TokenType::Comma},
+        {":", TokenType::Colon},
+        {"==", TokenType::ComparisonOperator},
+        {"!=", TokenType::ComparisonOperator},
+        {"<", TokenType::ComparisonOperator},
+        {">", TokenType::ComparisonOperator},
+        {"<=", TokenType::ComparisonOperator},
+        {">=", TokenType::ComparisonOperator},
+        {"&&", TokenType::LogicalOperator},
+        {"||", TokenType::LogicalOperator},
         // Add more symbols as needed
     };
 
@@ -406,7 +418,7 @@ TokenType getSymbolTokenType(const std::string& symbol) {
     return TokenType::Unknown; // Handle unexpected symbols
 }
 
-TokenType checkTokenType(const std::string &token)
+TokenType checkTokenType(std::string_view token)
 {
     TokenType type;
 
@@ -416,17 +428,30 @@ TokenType checkTokenType(const std::string &token)
         return TokenType::Identifier;
     }
 
+    if (isKeywordType(type))
+    {
+        return type;
+    }
+
     if (isNumber(token))
     {
         // If the token consists only of numeric characters, it's a number
-        return token.find('.') != std::string::npos ? TokenType::FloatNumber : TokenType::IntNumber;
+        return token.find('.') != std::string_view::npos ? TokenType::FloatNumber : TokenType::IntNumber;
     }
 
     // Handle other token types using switch statement
     switch (token[0])
     {
     case '=':
-        return TokenType::AssignmentOperator;
+        return token == "==" ? TokenType::ComparisonOperator : TokenType::AssignmentOperator;
+    case '<':
+    case '>':
+        return TokenType::ComparisonOperator;
+    case '!':
+        return token == "!=" ? TokenType::ComparisonOperator : TokenType::Unknown;
+    case '&':
+    case '|':
+        return token.size() == 2 && token[1] == token[0] ? TokenType::LogicalOperator : TokenType::Unknown;
     case '+':
     case '-':
     case '*':
@@ -448,6 +473,8 @@ TokenType checkTokenType(const std::string &token)
         return TokenType::Semicolon;
     case ',':
         return TokenType::Comma;
+    case ':':
+        return TokenType::Colon;
     // Add more cases for other token types as needed
     default:
         // If none of the above conditions match, it's an unknown token
@@ -455,18 +482,20 @@ TokenType checkTokenType(const std::string &token)
     }
 }
 
-void check_spacing(const std::vector<Token> &tokens)
+void check_spacing(const TokenBuffer &tokens)
 {
     for (size_t i = 1; i < tokens.size(); ++i)
     {
         // Check if the current token and the previous token are both non-skippable
-        if (tokens[i - 1].type != TokenType::Skip && tokens[i].type != TokenType::Skip)
+        if (tokens.type(i - 1) != TokenType::Skip && tokens.type(i) != TokenType::Skip)
         {
+            std::string_view previous = tokens.value(i - 1);
+            std::string_view current = tokens.value(i);
             // Check if there is no space between the tokens
-            if (tokens[i - 1].value.size() > 0 && tokens[i].value.size() > 0 &&
-                !isspace(tokens[i - 1].value.back()) && !isspace(tokens[i].value.front()))
+            if (previous.size() > 0 && current.size() > 0 &&
+                !isspace(previous.back()) && !isspace(current.front()))
             {
-                std::cerr << "Warning: No space between tokens '" << tokens[i - 1].value << "' and '" << tokens[i].value << "'." << std::endl;
+                std::cerr << "Warning: No space between tokens '" << previous << "' and '" << current << "'." << std::endl;
             }
         }
     }
@@ -0,0 +1,357 @@
+#include "lexer.hpp"
+#include "scan.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+struct Keyword
+{
+    const char *spelling;
+    TokenType type;
+};
+
+constexpr Keyword keywords[] = {
+    {"myn", TokenType::Myn},
+    {"for", TokenType::For},
+    {"while", TokenType::While},
+    {"switch", TokenType::Switch},
+    {"fun", TokenType::Fun},
+    {"class", TokenType::Class},
+    {"break", TokenType::Break},
+    {"case", TokenType::Case},
+    {"True", TokenType::True},
+    {"False", TokenType::False},
+    {"public", TokenType::Public},
+    {"enum", TokenType::Enum},
+    {"private", TokenType::Private},
+    {"protected", TokenType::Protected},
+    {"void", TokenType::Void},
+    {"this", TokenType::This},
+    {"throw", TokenType::Throw},
+    {"try", TokenType::Try},
+    {"catch", TokenType::Catch},
+    {"import", TokenType::Import},
+    {"continue", TokenType::Continue},
+    {"pass", TokenType::Pass},
+    {"NULL", TokenType::Null},
+    {"elif", TokenType::Elif},
+    {"else", TokenType::Else},
+    {"if", TokenType::If},
+    {"static", TokenType::Static},
+    {"return", TokenType::Return},
+    {"input", TokenType::Input},
+    {"output", TokenType::Output},
+
+    // Data types
+    {"int", TokenType::IntType},
+    {"float", TokenType::FloatType},
+    {"string", TokenType::StringType},
+    {"bool", TokenType::BooleanType},
+};
+
+constexpr size_t spellingLength(const char *spelling)
+{
+    size_t length = 0;
+    while (spelling[length] != '\0')
+    {
+        ++length;
+    }
+    return length;
+}
+
+// Keywords are told apart by length, first and last character alone, so the
+// hash only looks at those and a single memcmp confirms the match.
+constexpr size_t keywordSlots = 64;
+
+constexpr size_t keywordSlot(size_t length, char first, char last, unsigned lengthFactor, unsigned firstFactor)
+{
+    return (length * lengthFactor + static_cast<unsigned char>(first) * firstFactor + static_cast<unsigned char>(last)) &
+           (keywordSlots - 1);
+}
+
+struct KeywordSlot
+{
+    const char *spelling;
+    size_t length;
+    TokenType type;
+};
+
+struct KeywordTable
+{
+    unsigned lengthFactor;
+    unsigned firstFactor;
+    size_t minLength;
+    size_t maxLength;
+    KeywordSlot slots[keywordSlots];
+};
+
+// Searches for the first pair of factors that places every keyword in its own
+// slot. This runs entirely at compile time.
+constexpr KeywordTable buildKeywordTable()
+{
+    for (unsigned lengthFactor = 1; lengthFactor < keywordSlots; ++lengthFactor)
+    {
+        for (unsigned firstFactor = 1; firstFactor < keywordSlots; ++firstFactor)
+        {
+            KeywordTable table{lengthFactor, firstFactor, ~size_t(0), 0, {}};
+            bool collision = false;
+            for (const Keyword &keyword : keywords)
+            {
+                size_t length = spellingLength(keyword.spelling);
+                KeywordSlot &slot = table.slots[keywordSlot(length, keyword.spelling[0], keyword.spelling[length - 1],
+                                                            lengthFactor, firstFactor)];
+                if (slot.spelling != nullptr)
+                {
+                    collision = true;
+                    break;
+                }
+                slot = {keyword.spelling, length, keyword.type};
+                table.minLength = length < table.minLength ? length : table.minLength;
+                table.maxLength = length > table.maxLength ? length : table.maxLength;
+            }
+            if (!collision)
+            {
+                return table;
+            }
+        }
+    }
+    return {};
+}
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+static_assert(keywordTable.lengthFactor != 0, "no collision-free keyword hash, grow keywordSlots");
+
+} // namespace
+
+TokenType keywordType(std::string_view word)
+{
+    if (word.size() < keywordTable.minLength || word.size() > keywordTable.maxLength)
+    {
+        return TokenType::Identifier;
+    }
+    const KeywordSlot &slot = keywordTable.slots[keywordSlot(word.size(), word.front(), word.back(),
+                                                             keywordTable.lengthFactor, keywordTable.firstFactor)];
+    if (slot.length == word.size() && std::memcmp(slot.spelling, word.data(), word.size()) == 0)
+    {
+        return slot.type;
+    }
+    return TokenType::Identifier;
+}
+
+bool isKeywordType(TokenType type)
+{
+    return type >= TokenType::Myn && type <= TokenType::StringType;
+}
+
+namespace {
+
+// The config spells the boolean keywords in lowercase
+TokenType configKeyType(const std::string &key)
+{
+    if (key == "true")
+    {
+        return TokenType::True;
+    }
+    if (key == "false")
+    {
+        return TokenType::False;
+    }
+    return keywordType(key);
+}
+
+size_t remappedSlot(size_t length, char first, char last, size_t mask)
+{
+    return (length * 31 + static_cast<unsigned char>(first) * 7 + static_cast<unsigned char>(last)) & mask;
+}
+
+} // namespace
+
+LexerContext::LexerContext() : minLength(0), maxLength(0)
+{
+    buildStateMachine();
+}
+
+LexerContext::LexerContext(const std::unordered_map<std::string, std::string> &config) : minLength(~size_t(0)), maxLength(0)
+{
+    buildStateMachine();
+
+    // The config maps a default keyword to the spelling a script uses instead,
+    // and the default spelling stops being reserved
+    bool overridden[TokenType::Invalid + 1] = {};
+    std::vector<std::pair<std::string_view, TokenType>> effective;
+    for (const auto &entry : config)
+    {
+        TokenType type = configKeyType(entry.first);
+        if (isKeywordType(type) && !entry.second.empty())
+        {
+            effective.push_back({entry.second, type});
+            overridden[type] = true;
+        }
+    }
+    if (effective.empty())
+    {
+        minLength = maxLength = 0;
+        return; // Nothing remapped, keep using the compile-time table
+    }
+    for (const Keyword &keyword : keywords)
+    {
+        if (!overridden[keyword.type])
+        {
+            effective.push_back({keyword.spelling, keyword.type});
+        }
+    }
+
+    // Copy the spellings next to each other, then index them with an open
+    // addressing table at most half full
+    size_t slots = 64;
+    while (slots < effective.size() * 2)
+    {
+        slots *= 2;
+    }
+    table.assign(slots, Entry{0, 0, TokenType::Identifier});
+    for (const auto &keyword : effective)
+    {
+        std::string_view spelling = keyword.first;
+        size_t slot = remappedSlot(spelling.size(), spelling.front(), spelling.back(), slots - 1);
+        while (table[slot].length != 0)
+        {
+            if (std::string_view(spellings.data() + table[slot].offset, table[slot].length) == spelling)
+            {
+                break; // The same spelling twice, the first mapping wins
+            }
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (table[slot].length != 0)
+        {
+            continue;
+        }
+        table[slot] = Entry{static_cast<uint32_t>(spellings.size()), static_cast<uint32_t>(spelling.size()), keyword.second};
+        spellings.append(spelling.data(), spelling.size());
+        minLength = std::min(minLength, spelling.size());
+        maxLength = std::max(maxLength, spelling.size());
+    }
+}
+
+void LexerContext::buildStateMachine()
+{
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        classes[ch] = LexClassWord;
+    }
+    const struct
+    {
+        const char *bytes;
+        LexClass byteClass;
+    } delimiters[] = {
+        {" \t\n\r", LexClassSpace}, {"'\"", LexClassQuote},       {"#", LexClassHash},
+        {"(", LexClassOpenParen},   {")", LexClassCloseParen},    {"[", LexClassOpenSBracket},
+        {"]", LexClassCloseSBracket}, {"{", LexClassOpenBrace},   {"}", LexClassCloseBrace},
+        {"+", LexClassPlus},        {"-", LexClassMinus},         {"*", LexClassStar},
+        {"/", LexClassSlash},       {"=", LexClassEquals},        {";", LexClassSemicolon},
+        {",", LexClassComma},       {":", LexClassColon},         {"!", LexClassBang},
+        {"&", LexClassAmpersand},   {"|", LexClassPipe},          {"<", LexClassLess},
+        {">", LexClassGreater},
+    };
+    for (const auto &delimiter : delimiters)
+    {
+        for (const char *byte = delimiter.bytes; *byte != '\0'; ++byte)
+        {
+            classes[static_cast<unsigned char>(*byte)] = delimiter.byteClass;
+        }
+    }
+    // Words are scanned in bulk, so these must be exactly the bytes the
+    // scanner stops at
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        assert(isWordDelimiter(static_cast<char>(ch)) == (classes[ch] != LexClassWord));
+    }
+
+    // From the start state every class has its own action
+    LexTransition *start = transitions[LexStart];
+    start[LexClassEnd] = {LexStop, LexStart, TokenType::Invalid};
+    start[LexClassSpace] = {LexSkipSpace, LexStart, TokenType::Invalid};
+    start[LexClassQuote] = {LexString, LexStart, TokenType::String};
+    start[LexClassHash] = {LexSkipLineComment, LexStart, TokenType::Invalid};
+    start[LexClassWord] = {LexWord, LexStart, TokenType::Identifier};
+    start[LexClassOpenParen] = {LexEmit, LexStart, TokenType::OpenParen};
+    start[LexClassCloseParen] = {LexEmit, LexStart, TokenType::CloseParen};
+    start[LexClassOpenSBracket] = {LexEmit, LexStart, TokenType::OpenSBracket};
+    start[LexClassCloseSBracket] = {LexEmit, LexStart, TokenType::CloseSBracket};
+    start[LexClassOpenBrace] = {LexEmit, LexStart, TokenType::OpenBrace};
+    start[LexClassCloseBrace] = {LexEmit, LexStart, TokenType::CloseBrace};
+    start[LexClassPlus] = {LexEmit, LexStart, TokenType::ArithmeticOperator};
+    start[LexClassMinus] = {LexEmit, LexStart, TokenType::ArithmeticOperator};
+    start[LexClassStar] = {LexEmit, LexStart, TokenType::ArithmeticOperator};
+    start[LexClassSlash] = {LexShift, LexAfterSlash, TokenType::Invalid};
+    start[LexClassEquals] = {LexShift, LexAfterEquals, TokenType::Invalid};
+    start[LexClassSemicolon] = {LexEmit, LexStart, TokenType::Semicolon};
+    start[LexClassComma] = {LexEmit, LexStart, TokenType::Comma};
+    start[LexClassColon] = {LexEmit, LexStart, TokenType::Colon};
+    start[LexClassBang] = {LexShift, LexAfterBang, TokenType::Invalid};
+    start[LexClassAmpersand] = {LexShift, LexAfterAmpersand, TokenType::Invalid};
+    start[LexClassPipe] = {LexShift, LexAfterPipe, TokenType::Invalid};
+    start[LexClassLess] = {LexShift, LexAfterAngle, TokenType::Invalid};
+    start[LexClassGreater] = {LexShift, LexAfterAngle, TokenType::Invalid};
+
+    // After '/', a '*' opens a comment; anything else leaves a lone division
+    LexTransition *afterSlash = transitions[LexAfterSlash];
+    for (int byteClass = 0; byteClass < LexClassCount; ++byteClass)
+    {
+        afterSlash[byteClass] = {LexEmitBefore, LexStart, TokenType::ArithmeticOperator};
+    }
+    afterSlash[LexClassStar] = {LexSkipBlockComment, LexStart, TokenType::Invalid};
+
+    // The two-byte operators: the second byte completes the pair, anything
+    // else leaves the first byte on its own
+    const struct
+    {
+        LexState state;
+        LexClass second;
+        TokenType pair;
+        TokenType single; // Unknown when the byte means nothing alone
+    } pairs[] = {
+        {LexAfterEquals, LexClassEquals, TokenType::ComparisonOperator, TokenType::AssignmentOperator},
+        {LexAfterBang, LexClassEquals, TokenType::ComparisonOperator, TokenType::Unknown},
+        {LexAfterAngle, LexClassEquals, TokenType::ComparisonOperator, TokenType::ComparisonOperator},
+        {LexAfterAmpersand, LexClassAmpersand, TokenType::LogicalOperator, TokenType::Unknown},
+        {LexAfterPipe, LexClassPipe, TokenType::LogicalOperator, TokenType::Unknown},
+    };
+    for (const auto &pair : pairs)
+    {
+        LexTransition *row = transitions[pair.state];
+        for (int byteClass = 0; byteClass < LexClassCount; ++byteClass)
+        {
+            row[byteClass] = {LexEmitBefore, LexStart, pair.single};
+        }
+        row[pair.second] = {LexEmit, LexStart, pair.pair};
+    }
+}
+
+const LexerContext &LexerContext::defaults()
+{
+    static const LexerContext context;
+    return context;
+}
+
+TokenType LexerContext::remappedKeyword(std::string_view word) const
+{
+    if (word.size() < minLength || word.size() > maxLength)
+    {
+        return TokenType::Identifier;
+    }
+    size_t mask = table.size() - 1;
+    for (size_t slot = remappedSlot(word.size(), word.front(), word.back(), mask);; slot = (slot + 1) & mask)
+    {
+        const Entry &entry = table[slot];
+        if (entry.length == 0)
+        {
+            return TokenType::Identifier;
+        }
+        if (entry.length == word.size() && std::memcmp(spellings.data() + entry.offset, word.data(), word.size()) == 0)
+        {
+            return entry.type;
+        }
+    }
+}
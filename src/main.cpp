@@ -1,14 +1,41 @@
 #include <iostream>
 #include <string>
+#include "bytecode.hpp"
 #include "lexer.hpp"
+#include "module.hpp"
+#include "optimizer.hpp"
 #include <filesystem>
 #include <unordered_map>
 #include <algorithm>
 #include <fstream>
 #include <parser.hpp>
+#include "source.hpp"
+#include "thread_pool.hpp"
+#include "token_cache.hpp"
+#include "vm.hpp"
+#include <memory>
 
 namespace fs = std::filesystem;
 
+// Command-line switches that change how a file is processed
+struct DriverOptions {
+    bool stream = false;         // Lex and parse in one pass, without a token vector
+    size_t jobs = 0;             // Lexer threads, 0 for one per core
+    ThreadPool *pool = nullptr;  // Where large files are lexed in parallel
+    bool useCache = true;        // Reuse the tokens of unchanged sources
+    std::string cacheDirectory;  // Empty for TokenCache::defaultDirectory()
+    bool dumpAst = false;        // Print the syntax tree after parsing
+    size_t nestingLimit = Parser::DefaultNestingLimit; // Deepest block nesting, 0 for none
+    bool parallelParse = false;  // Parse top-level declarations concurrently on the pool
+    bool lazyBodies = false;     // Leave function bodies unparsed until needed
+    bool emitModule = false;     // Write the compiled module next to the source
+    bool run = false;            // Execute the program; stdout is then the program's alone
+    bool dumpBytecode = false;   // Print the compiled program
+    unsigned optimization = 0;   // -O level the tree is optimized at before compiling
+    bool dumpOptStats = false;   // Report what the optimizer did, on stderr
+    bool verboseInline = false;  // Report why each call was inlined or not, on stderr
+};
+
 std::unordered_set<std::string> reservedKeywordsForConfig = {
   "myn", "for", "while", "switch", "fun", "class", "break", "case", "true", "false", 
   "public", "enum", "private", "protected", "void", "this", "throw", "try", "catch", 
@@ -82,6 +109,11 @@ bool hasValidExtension(const std::string &filename) {
     return extension == ".myn" || extension == ".MYN";
 }
 
+bool isModule(const std::string &filename) {
+    std::string extension = std::filesystem::path(filename).extension().string();
+    return extension == ".mynm" || extension == ".MYNM";
+}
+
 std::string getAbsolutePath(const std::string &filename) {
     if (!fs::exists(filename)) {
         std::cout << "Error: File Not Found \"" << filename << "\"" << std::endl;
@@ -125,72 +157,264 @@ bool searchForConfigFile(const std::string &filename) {
     return false;
 }
 
-void handleFile(const std::string &filename) {
-    std::ifstream file(filename);
+// Holds the cache entries and remembers which modules passed their checks
+TokenCache openCache(const DriverOptions &options) {
+    return TokenCache(options.cacheDirectory.empty() ? TokenCache::defaultDirectory() : options.cacheDirectory);
+}
 
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open the file " << filename << std::endl;
+// Writes the module for a cleanly parsed source. Stdin has no place to put it.
+// The module is checked once here, so importing it later does not have to.
+void emitModule(const std::string &filename, const Ast &ast, std::string_view text, uint64_t configHash,
+                const DriverOptions &options) {
+    if (filename == "-") {
         return;
     }
+    std::string path = modulePath(filename);
+    std::string error;
+    TokenCache cache = openCache(options);
+    Module written;
+    if (!writeModule(path, ast, globalSymbols(), cacheKey(text, configHash, options.nestingLimit), error) ||
+        (options.useCache && !written.open(path, &cache, error))) {
+        std::cerr << "Warning: " << error << std::endl;
+    }
+}
 
-    // Read the contents of the file into a string
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string fileContent = buffer.str();
+// Whether the program gets compiled at all. The token and export listings are
+// then left out, so stdout holds only the program's output or the dump asked for.
+bool compiles(const DriverOptions &options) {
+    return options.run || options.dumpBytecode || options.dumpOptStats || options.verboseInline;
+}
 
-    if (file.bad()) {
-        std::cerr << "Error: An I/O error occurred while reading the file " << filename << std::endl;
-        file.close();
-        return;
+// Starts a message about offset in filename, "file:line:col: ", or just
+// "file: " when there is no source (lines is null)
+void printLocation(const std::string &filename, const LineIndex *lines, uint32_t offset) {
+    std::cerr << filename;
+    if (lines != nullptr) {
+        SourceLocation location = lines->locate(offset);
+        std::cerr << ':' << location.line << ':' << location.column;
     }
+    std::cerr << ": ";
+}
 
-    file.close();
+// Links the imports of a cleanly parsed program, then compiles and runs it.
+// lines is null when there is no source to point into. Returns false on errors.
+bool runProgram(const std::string &filename, Ast &ast, const LineIndex *lines, const DriverOptions &options) {
+    // Modules are looked for next to the source, which for stdin is here
+    TokenCache cache = openCache(options);
+    std::string error;
+    std::string directory = std::filesystem::path(filename).parent_path().string();
+    if (!linkImports(ast, globalSymbols(), directory, options.useCache ? &cache : nullptr, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
 
-    // Tokenize the file content
-    std::vector<Token> tokens = tokenize(fileContent);
+    // Whether the program is valid is decided on the tree as written, so the
+    // optimizer cannot hide errors in code it removes
+    const LineIndex none;
+    const LineIndex &index = lines != nullptr ? *lines : none;
+    Bytecode program;
+    Diagnostics errors;
+    compileProgram(ast, globalSymbols(), index, program, errors);
+    if (!errors.empty()) {
+        errors.print(std::cerr, filename);
+        return false;
+    }
 
-    // Now you can do something with the tokens, like parsing or interpreting them
-    // For now, let's just print them
-    for (const Token& token : tokens) {
-        std::cout << "Token: " << token.value << " => Type: " << static_cast<int>(token.type) << std::endl;
+    // At -O0 the optimizer only copies the tree, which still gives a report
+    // with no passes run
+    if (options.optimization > 0 || options.dumpOptStats) {
+        OptimizationStats stats;
+        Ast optimized = optimizeAst(ast, globalSymbols(), options.optimization, stats);
+        if (options.dumpOptStats) {
+            printOptimizationStats(stats, std::cerr);
+        }
+        for (size_t i = 0; i < stats.inlining.size() && options.verboseInline; ++i) {
+            const InlineDecision &decision = stats.inlining[i];
+            printLocation(filename, lines, decision.offset);
+            std::cerr << (decision.inlined ? "inlined " : "did not inline ") << globalSymbols().name(decision.callee)
+                      << " into "
+                      << (decision.caller == NoAtom ? std::string_view("the top level")
+                                                    : globalSymbols().name(decision.caller))
+                      << ": " << decision.reason << std::endl;
+        }
+        if (options.optimization > 0) {
+            program = Bytecode();
+            compileProgram(optimized, globalSymbols(), index, program, errors, true);
+            if (!errors.empty()) {
+                errors.print(std::cerr, filename);
+                return false;
+            }
+        }
+    }
+    if (options.dumpBytecode) {
+        dumpBytecode(program, globalSymbols(), std::cout);
+    }
+    if (!options.run) {
+        return true;
     }
 
-     // Now create a parser instance
-    Parser parser(tokens);
+    VM vm(program, std::cout);
     try {
-        parser.parse(); // Start parsing the tokens
-    } catch (const std::exception& e) {
-        std::cerr << "Parsing error: " << e.what() << std::endl;
+        vm.run();
+    } catch (const RuntimeError &error) {
+        std::cout.flush();
+        printLocation(filename, lines, error.offset);
+        std::cerr << "runtime error: " << error.what() << std::endl;
+        return false;
     }
+    return true;
 }
 
-void handleFileWithConfig(const std::string &filename, std::unordered_map<std::string, std::string> config) {
-    std::ifstream file(filename);
+// A compiled module is mapped and used as it is, without lexing or parsing
+bool handleModule(const std::string &filename, const DriverOptions &options) {
+    TokenCache cache = openCache(options);
+    Module module;
+    std::string error;
+    if (!module.open(filename, options.useCache ? &cache : nullptr, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < module.exportCount() && !compiles(options); ++i) {
+        const ModuleExport &entry = module.exports()[i];
+        std::cout << "Export: " << module.name(entry.name) << " => "
+                  << astKindName(module.nodes()[entry.node].kind) << std::endl;
+    }
+    if (options.dumpAst || compiles(options)) {
+        Ast ast = module.toAst(globalSymbols());
+        if (options.dumpAst) {
+            dumpAst(ast, globalSymbols(), std::cout);
+        }
+        if (compiles(options) && !runProgram(filename, ast, nullptr, options)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open the file " << filename << std::endl;
-        return;
+// Default and myn.config keywords go through the same lexer; only the context
+// differs. configHash identifies the mapping the context was built from.
+// Returns false if the file could not be read or has errors.
+bool handleFile(const std::string &filename, const DriverOptions &options,
+                const LexerContext &context = LexerContext::defaults(), uint64_t configHash = hashConfig({})) {
+    // Map the file (or read it, for pipes and stdin); tokens point into it
+    SourceFile source;
+    std::string error;
+    if (!source.open(filename, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string fileContent = buffer.str();
+    if (options.stream) {
+        // The parser pulls tokens straight from the lexer
+        Lexer lexer(source.text(), globalSymbols(), context);
+        TokenStream stream(lexer);
+        Parser parser(stream);
+        parser.setNestingLimit(options.nestingLimit);
+        try {
+            parser.parse();
+        } catch (const std::exception& e) {
+            std::cerr << "Parsing error: " << e.what() << std::endl;
+            return false;
+        }
+        if (!parser.diagnostics().empty()) {
+            parser.diagnostics().print(std::cerr, filename);
+            return false;
+        }
+        if (options.dumpAst) {
+            dumpAst(parser.ast(), globalSymbols(), std::cout);
+        }
+        if (options.emitModule) {
+            emitModule(filename, parser.ast(), source.text(), configHash, options);
+        }
+        if (compiles(options)) {
+            LineIndex lines(source.text());
+            return runProgram(filename, parser.ast(), &lines, options);
+        }
+        return true;
+    }
 
-    file.close();
+    // Token offsets are 32 bits
+    if (source.text().size() > TokenBuffer::MaxSourceSize) {
+        std::cerr << "Error: " << filename << " is larger than 4 GiB" << std::endl;
+        return false;
+    }
 
-    std::vector<Token> tokens = tokenize_with_config(fileContent, config);
+    // An unchanged source under the same config and limits was lexed and
+    // parsed before
+    TokenCache cache = openCache(options);
+    CacheKey key = {};
+    TokenBuffer tokens;
+    Ast cachedTree;
+    bool cached = false;
+    if (options.useCache) {
+        key = cacheKey(source.text(), configHash, options.nestingLimit);
+        cached = cache.load(key, source.text(), globalSymbols(), tokens, cachedTree);
+    }
 
-    for (const Token& token : tokens) {
-        std::cout << "Token: " << token.value << " => Type: " << static_cast<int>(token.type) << std::endl;
+    // Tokenize the file content, in parallel chunks when it is large
+    if (!cached) {
+        tokens = tokenizeParallel(source.text(), globalSymbols(), *options.pool, context);
+    }
+
+    // Now you can do something with the tokens, like parsing or interpreting them
+    // For now, let's just print them
+    for (size_t i = 0; i < tokens.size() && !compiles(options); ++i) {
+        std::cout << "Token: " << tokens.value(i) << " => Type: " << static_cast<int>(tokens.type(i)) << std::endl;
     }
 
-     // Now create a parser instance
+     // Now create a parser instance. On a cache hit the tree was stored
+     // along with the tokens, cleanly parsed, and the parser never runs.
     Parser parser(tokens);
-    try {
-        parser.parse(); // Start parsing the tokens
-    } catch (const std::exception& e) {
-        std::cerr << "Parsing error: " << e.what() << std::endl;
+    if (cached) {
+        parser.ast() = std::move(cachedTree);
+    } else {
+        parser.setNestingLimit(options.nestingLimit);
+        parser.setLazyBodies(options.lazyBodies);
+        try {
+            if (options.parallelParse) {
+                parser.parseParallel(*options.pool);
+            } else {
+                parser.parse(); // Start parsing the tokens
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Parsing error: " << e.what() << std::endl;
+            return false;
+        }
+        if (!parser.diagnostics().empty()) {
+            parser.diagnostics().print(std::cerr, filename);
+            return false;
+        }
+
+        // A cache that cannot be written only costs the next run some time.
+        // Bodies left unparsed have not been checked, so a lazy parse does
+        // not count as a clean one.
+        if (options.useCache && !options.lazyBodies &&
+            !cache.store(key, tokens, parser.ast(), globalSymbols(), error)) {
+            std::cerr << "Warning: " << error << std::endl;
+        }
+    }
+    if (options.dumpAst) {
+        dumpAst(parser.ast(), globalSymbols(), std::cout);
+    }
+    if (options.emitModule) {
+        emitModule(filename, parser.ast(), source.text(), configHash, options);
     }
+    if (compiles(options)) {
+        // Every body is needed after all
+        if (options.lazyBodies && !cached) {
+            for (NodeId id = 1, last = static_cast<NodeId>(parser.ast().size()); id < last; ++id) {
+                if (parser.ast().kind(id) == AstFunction) {
+                    parser.materialize(id);
+                }
+            }
+            if (!parser.diagnostics().empty()) {
+                parser.diagnostics().print(std::cerr, filename);
+                return false;
+            }
+        }
+        return runProgram(filename, parser.ast(), &tokens.lineIndex(), options);
+    }
+    return true;
 }
 
 int main(int argc, char const *argv[]) {
@@ -202,36 +426,104 @@ int main(int argc, char const *argv[]) {
     }
 
     int fileCount = 0;
+    bool failed = false;
+    DriverOptions options;
 
-    // Using a for loop to iterate through command-line arguments
+    // Options may appear anywhere, so pick them out first
+    std::vector<std::string> filenames;
     for (int i = 1; i < argc; i++) {
-        std::string filename = argv[i];
-        
-        if (hasValidExtension(filename)) {
+        std::string argument = argv[i];
+        if (argument == "--stream") {
+            options.stream = true;
+        } else if (argument.compare(0, 7, "--jobs=") == 0) {
+            options.jobs = std::strtoul(argument.c_str() + 7, nullptr, 10);
+        } else if (argument == "--no-cache") {
+            options.useCache = false;
+        } else if (argument.compare(0, 12, "--cache-dir=") == 0) {
+            options.cacheDirectory = argument.substr(12);
+        } else if (argument.compare(0, 14, "--max-nesting=") == 0) {
+            options.nestingLimit = std::strtoul(argument.c_str() + 14, nullptr, 10);
+        } else if (argument == "--parallel-parse") {
+            options.parallelParse = true;
+        } else if (argument == "--lazy") {
+            options.lazyBodies = true;
+        } else if (argument == "--emit-module") {
+            options.emitModule = true;
+        } else if (argument == "--run") {
+            options.run = true;
+        } else if (argument == "--dump-bytecode") {
+            options.dumpBytecode = true;
+        } else if (argument.size() == 3 && argument.compare(0, 2, "-O") == 0 && argument[2] >= '0' &&
+                   argument[2] <= static_cast<char>('0' + MaxOptimizationLevel)) {
+            options.optimization = argument[2] - '0';
+        } else if (argument == "--dump-opt-stats") {
+            options.dumpOptStats = true;
+        } else if (argument == "--verbose-inline") {
+            options.verboseInline = true;
+        } else if (argument == "--dump-ast") {
+            options.dumpAst = true;
+        } else if ((argument.size() > 2 && argument.compare(0, 2, "--") == 0) || argument.compare(0, 2, "-O") == 0) {
+            std::cerr << "Error: Unknown option " << argument << std::endl;
+            return 1;
+        } else {
+            filenames.push_back(argument);
+        }
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    if (options.jobs != 0) {
+        ownPool.reset(new ThreadPool(options.jobs));
+        options.pool = ownPool.get();
+    } else {
+        options.pool = &sharedThreadPool();
+    }
+
+    // Using a for loop to iterate through command-line arguments
+    for (const std::string &filename : filenames) {
+        if (filename == "-") {
+            // Read the program from stdin, there is no directory to look for a config in
+            if (fileCount == 0) {
+                failed |= !handleFile(filename, options);
+                fileCount++;
+            } else {
+                std::cout << "Info: " << filename << " ignored." << std::endl;
+            }
+        } else if (isModule(filename)) {
+            // Modules were compiled under their config already
+            failed |= !handleModule(filename, options);
+        } else if (hasValidExtension(filename)) {
             if (fileCount == 0) {
                 // Search for the config file in the directory of the current file
                 if (searchForConfigFile(filename)) {
-                    std::cout << "Using configurations from myn.config file." << std::endl;
+                    if (!compiles(options)) {
+                        std::cout << "Using configurations from myn.config file." << std::endl;
+                    }
                     std::unordered_map<std::string, std::string> config = readConfigFile("myn.config");
                     
-                    handleFileWithConfig(filename, config);
+                    // The keyword remapping is compiled once and shared from here on
+                    const LexerContext context(config);
+                    failed |= !handleFile(filename, options, context, hashConfig(config));
                     
                 // Printing the contents of 'config' map
                 for (const auto& pair : config) {
-                    std::cout << pair.first << " = " << pair.second << std::endl;
+                    if (!compiles(options)) {
+                        std::cout << pair.first << " = " << pair.second << std::endl;
+                    }
                 }
                 } else {
-                    std::cout << "No myn.config file found. Proceeding with default configurations." << std::endl;
-                    handleFile(filename);
+                    if (!compiles(options)) {
+                        std::cout << "No myn.config file found. Proceeding with default configurations." << std::endl;
+                    }
+                    failed |= !handleFile(filename, options);
                 }
                 fileCount++;
             } else {
                 std::cout << "Info: " << filename << " ignored." << std::endl;
             }
         } else {
-            std::cout << "Error: " << filename << " has an unrecognized file extension." << std::endl << "Expected: .myn or .MYN" << std::endl;
+            std::cout << "Error: " << filename << " has an unrecognized file extension." << std::endl << "Expected: .myn, .MYN or .mynm" << std::endl;
         }
     }
 
-    return 0;
+    return failed ? 1 : 0;
 }
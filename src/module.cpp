@@ -0,0 +1,863 @@
+#include "module.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bumped whenever the layout below changes. The number of node kinds is mixed
+// in as well, since modules store AstKind values.
+const uint32_t ModuleFormat = 2;
+const uint32_t ModuleVersion = ModuleFormat << 8 | AstKindCount;
+const char ModuleMagic[8] = {'M', 'Y', 'N', 'M', 'O', 'D', 'U', 'L'};
+
+// The file starts with this, followed by
+//   AstNode      nodes[nodeCount]      atoms are local: 0, or 1 + a name index
+//   uint32_t     extra[extraCount]     likewise
+//   ModuleExport exports[exportCount]  sorted by name
+//   uint32_t     nameEnds[nameCount]   end of each name in the name bytes
+//   char         names[nameBytes]
+// Every section is a multiple of 4 bytes long and so stays aligned.
+struct ModuleHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t sourceHash;
+    uint64_t configHash;
+    uint64_t sourceSize;
+    uint64_t checksum; // hashBytes over the sections, each seeded with the hash of those before
+    uint32_t nodeCount;
+    uint32_t extraCount;
+    uint32_t root;
+    uint32_t exportCount;
+    uint32_t nameCount;
+    uint32_t nameBytes;
+};
+
+template <typename T>
+void writeArray(std::ofstream &file, const T *values, size_t count) {
+    file.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+}
+
+template <typename T>
+uint64_t hashArray(const T *values, size_t count, uint64_t seed) {
+    return hashBytes(std::string_view(reinterpret_cast<const char *>(values), count * sizeof(T)), seed);
+}
+
+// Checks, in one pass from the first node up, that a stored tree is shaped
+// the way the parser builds them: every field in range, each child below its
+// parent and used only once, children of the kinds their parent allows, and
+// every expression a contiguous post-order run. Whatever reads the tree may
+// then trust it as it trusts the parser's.
+class TreeChecker
+{
+public:
+    TreeChecker(const AstNode *nodes, size_t nodeCount, const uint32_t *extra, size_t extraCount, size_t nameCount)
+        : nodes(nodes), nodeCount(nodeCount), extra(extra), extraCount(extraCount), nameCount(nameCount),
+          used(nodeCount, false), first(nodeCount, NoNode) {}
+
+    bool check(NodeId root) {
+        for (NodeId id = 1; id < nodeCount; ++id) {
+            if (!checkNode(id)) {
+                return false;
+            }
+        }
+        return nodes[root].kind == AstProgram && !used[root];
+    }
+
+private:
+    const AstNode *nodes;
+    size_t nodeCount;
+    const uint32_t *extra;
+    size_t extraCount;
+    size_t nameCount;
+    std::vector<bool> used;
+    std::vector<NodeId> first; // Of the post-order run of each expression
+
+    static bool isExpression(uint8_t kind) { return kind >= AstInt && kind <= AstBinary; }
+    static bool isStatement(uint8_t kind) { return kind >= AstVariable && kind <= AstOutput; }
+
+    bool atom(uint32_t value) const { return value <= nameCount; }
+    bool record(uint64_t start, uint64_t count) const { return start + count <= extraCount; }
+
+    // child, below parent and not claimed by another node yet
+    bool take(NodeId child, NodeId parent) {
+        if (child == NoNode || child >= parent || used[child]) {
+            return false;
+        }
+        used[child] = true;
+        return true;
+    }
+
+    bool takeKind(NodeId child, NodeId parent, AstKind kind) {
+        return take(child, parent) && nodes[child].kind == kind;
+    }
+
+    bool takeStatement(NodeId child, NodeId parent) {
+        return take(child, parent) && isStatement(nodes[child].kind);
+    }
+
+    bool takeExpression(NodeId child, NodeId parent) {
+        return take(child, parent) && isExpression(nodes[child].kind);
+    }
+
+    // Operands of the expression id, which have to end right before it one
+    // after the other; sets where the whole run starts
+    bool takeOperands(NodeId id, const uint32_t *operands, size_t count) {
+        NodeId end = id;
+        for (size_t i = count; i-- > 0;) {
+            if (operands[i] + 1 != end || !takeExpression(operands[i], id)) {
+                return false;
+            }
+            end = first[operands[i]];
+        }
+        first[id] = end;
+        return true;
+    }
+
+    bool checkNode(NodeId id) {
+        const AstNode &node = nodes[id];
+        switch (node.kind) {
+        case AstProgram:
+        case AstBlock: {
+            if (!record(node.a, node.b)) {
+                return false;
+            }
+            for (uint32_t i = node.a; i < node.a + node.b; ++i) {
+                uint8_t kind = take(extra[i], id) ? nodes[extra[i]].kind : AstNone;
+                bool declaration =
+                    node.kind == AstProgram && (kind == AstFunction || kind == AstClass || kind == AstImport);
+                if (!isStatement(kind) && !declaration) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case AstFunction:
+        case AstClass: {
+            if (!atom(node.a) || !record(node.b, 2) || !record(node.b + 2, extra[node.b + 1])) {
+                return false;
+            }
+            bool function = node.kind == AstFunction;
+            if (function ? !takeKind(extra[node.b], id, AstBlock) : !atom(extra[node.b])) {
+                return false;
+            }
+            for (uint32_t i = node.b + 2; i < node.b + 2 + extra[node.b + 1]; ++i) {
+                uint8_t kind = take(extra[i], id) ? nodes[extra[i]].kind : AstNone;
+                if (function ? kind != AstParameter : kind != AstVariable && kind != AstFunction) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case AstParameter:
+            return node.op <= AstTypeClass && atom(node.a) && atom(node.b);
+        case AstImport:
+            return node.a != NoAtom && atom(node.a);
+        case AstVariable:
+            return node.op <= AstTypeClass && atom(node.a) && record(node.b, 2) && atom(extra[node.b]) &&
+                   (extra[node.b + 1] == NoNode || takeExpression(extra[node.b + 1], id));
+        case AstExpressionStatement:
+        case AstReturn:
+        case AstOutput:
+            return takeExpression(node.a, id);
+        case AstIf:
+            return takeExpression(node.a, id) && record(node.b, 2) && takeKind(extra[node.b], id, AstBlock) &&
+                   (extra[node.b + 1] == NoNode || takeKind(extra[node.b + 1], id, AstBlock));
+        case AstWhile:
+            return takeExpression(node.a, id) && takeKind(node.b, id, AstBlock);
+        case AstFor: {
+            if (!record(node.a, 4)) {
+                return false;
+            }
+            const uint32_t *parts = extra + node.a;
+            uint8_t initializer = take(parts[0], id) ? nodes[parts[0]].kind : AstNone;
+            return (initializer == AstVariable || initializer == AstExpressionStatement) &&
+                   takeExpression(parts[1], id) && takeExpression(parts[2], id) && takeKind(parts[3], id, AstBlock);
+        }
+        case AstInt:
+        case AstFloat:
+        case AstBool:
+        case AstNull:
+            first[id] = id;
+            return true;
+        case AstString:
+        case AstName:
+            first[id] = id;
+            return atom(node.a);
+        case AstAssign:
+            return atom(node.a) && takeOperands(id, &node.b, 1);
+        case AstCall:
+            return atom(node.a) && record(node.b, 1) && record(node.b + 1, extra[node.b]) &&
+                   takeOperands(id, extra + node.b + 1, extra[node.b]);
+        case AstArray:
+            return record(node.a, node.b) && takeOperands(id, extra + node.a, node.b);
+        case AstBinary: {
+            const uint32_t operands[2] = {node.a, node.b};
+            return node.op <= AstOr && takeOperands(id, operands, 2);
+        }
+        default:
+            // Placeholders, unparsed bodies (never written) and unknown kinds
+            return false;
+        }
+    }
+};
+
+} // namespace
+
+std::string modulePath(const std::string &path) {
+    return path + "m";
+}
+
+bool Module::open(const std::string &path, const TokenCache *cache, std::string &error) {
+    if (!file.open(path, error)) {
+        return false;
+    }
+    std::error_code code;
+    modified = static_cast<uint64_t>(std::filesystem::last_write_time(path, code).time_since_epoch().count());
+
+    std::string_view bytes = file.text();
+    ModuleHeader header;
+    if (bytes.size() < sizeof(header)) {
+        error = path + " is not a module";
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, ModuleMagic, sizeof(ModuleMagic)) != 0) {
+        error = path + " is not a module";
+        return false;
+    }
+    if (header.version != ModuleVersion) {
+        error = path + " was compiled by another version of myn";
+        return false;
+    }
+
+    // The sections have to add up to the file exactly
+    const uint64_t nodesAt = sizeof(header);
+    const uint64_t extraAt = nodesAt + uint64_t(header.nodeCount) * sizeof(AstNode);
+    const uint64_t exportsAt = extraAt + uint64_t(header.extraCount) * 4;
+    const uint64_t nameEndsAt = exportsAt + uint64_t(header.exportCount) * sizeof(ModuleExport);
+    const uint64_t namesAt = nameEndsAt + uint64_t(header.nameCount) * 4;
+    const char *data = bytes.data();
+    if (namesAt + header.nameBytes != bytes.size() || header.nodeCount == 0 || header.root >= header.nodeCount ||
+        reinterpret_cast<uintptr_t>(data) % alignof(AstNode) != 0) {
+        error = path + " is damaged";
+        return false;
+    }
+
+    checksum = header.checksum;
+    sourceHash = header.sourceHash;
+    configHash = header.configHash;
+    sourceSize = header.sourceSize;
+    nodeArray = reinterpret_cast<const AstNode *>(data + nodesAt);
+    nodeTotal = header.nodeCount;
+    extraArray = reinterpret_cast<const uint32_t *>(data + extraAt);
+    extraTotal = header.extraCount;
+    rootNode = header.root;
+    exportArray = reinterpret_cast<const ModuleExport *>(data + exportsAt);
+    exportTotal = header.exportCount;
+    nameEnds = reinterpret_cast<const uint32_t *>(data + nameEndsAt);
+    nameTotal = header.nameCount;
+    nameBytes = data + namesAt;
+    nameSize = header.nameBytes;
+
+    // Exports and name ends are few, and checking them keeps find() and
+    // name() within the file whether or not the rest is checked
+    uint32_t nameStart = 0;
+    for (size_t i = 0; i < nameTotal; ++i) {
+        if (nameEnds[i] < nameStart || nameEnds[i] > header.nameBytes) {
+            error = path + " is damaged";
+            return false;
+        }
+        nameStart = nameEnds[i];
+    }
+    for (size_t i = 0; i < exportTotal; ++i) {
+        if (exportArray[i].name == NoAtom || exportArray[i].name > nameTotal || exportArray[i].node >= nodeTotal) {
+            error = path + " is damaged";
+            return false;
+        }
+    }
+
+    if (cache != nullptr && cache->trusts(stamp())) {
+        return true;
+    }
+    if (!verify(path, error)) {
+        return false;
+    }
+    if (cache != nullptr) {
+        cache->trust(stamp());
+    }
+    return true;
+}
+
+// Damage that leaves a well-formed tree, say a changed literal, only shows in
+// the checksum. The tree is walked by code that trusts its shape, so that is
+// checked too, in a single pass over the nodes.
+bool Module::verify(const std::string &path, std::string &error) const {
+    uint64_t sum = hashArray(nodeArray, nodeTotal, 0);
+    sum = hashArray(extraArray, extraTotal, sum);
+    sum = hashArray(exportArray, exportTotal, sum);
+    sum = hashArray(nameEnds, nameTotal, sum);
+    sum = hashArray(nameBytes, nameSize, sum);
+    if (sum != checksum || !TreeChecker(nodeArray, nodeTotal, extraArray, extraTotal, nameTotal).check(rootNode)) {
+        error = path + " is damaged";
+        return false;
+    }
+    return true;
+}
+
+uint64_t Module::stamp() const {
+    const uint64_t fields[3] = {checksum, file.text().size(), modified};
+    return hashArray(fields, 3, 0);
+}
+
+NodeId Module::find(std::string_view wanted) const {
+    const ModuleExport *end = exportArray + exportTotal;
+    const ModuleExport *entry =
+        std::lower_bound(exportArray, end, wanted,
+                         [&](const ModuleExport &left, std::string_view right) { return name(left.name) < right; });
+    return entry != end && name(entry->name) == wanted ? entry->node : NoNode;
+}
+
+bool Module::matches(const CacheKey &key) const {
+    return sourceHash == key.source && configHash == key.config && sourceSize == key.size;
+}
+
+std::string_view Module::name(uint32_t local) const {
+    if (local == NoAtom || local > nameTotal) {
+        return std::string_view();
+    }
+    uint32_t start = local > 1 ? nameEnds[local - 2] : 0;
+    return std::string_view(nameBytes + start, nameEnds[local - 1] - start);
+}
+
+Ast Module::toAst(SymbolTable &symbols) const {
+    std::vector<Atom> atoms(nameTotal + 1, NoAtom);
+    for (size_t i = 1; i <= nameTotal; ++i) {
+        atoms[i] = symbols.intern(name(static_cast<uint32_t>(i)));
+    }
+
+    Ast ast;
+    ast.assign(nodeArray, nodeTotal, extraArray, extraTotal, rootNode);
+    ast.forEachAtom([&](Atom &atom) { atom = atom <= nameTotal ? atoms[atom] : NoAtom; });
+    return ast;
+}
+
+bool writeModule(const std::string &path, const Ast &ast, const SymbolTable &symbols, const CacheKey &key,
+                 std::string &error) {
+    for (NodeId id = 1; id < ast.size(); ++id) {
+        if (ast.kind(id) == AstLazyBody) {
+            error = "Cannot write the module " + path + " while function bodies are unparsed";
+            return false;
+        }
+    }
+
+    // Only the names the tree uses, numbered in order of first use
+    Ast local = ast;
+    std::vector<uint32_t> numbers(symbols.size(), 0);
+    std::vector<Atom> used;
+    local.forEachAtom([&](Atom &atom) {
+        if (atom != NoAtom && numbers[atom] == 0) {
+            used.push_back(atom);
+            numbers[atom] = static_cast<uint32_t>(used.size());
+        }
+        atom = numbers[atom];
+    });
+    std::vector<uint32_t> nameEnds;
+    std::string names;
+    for (Atom atom : used) {
+        names += symbols.name(atom);
+        nameEnds.push_back(static_cast<uint32_t>(names.size()));
+    }
+
+    // Top-level declarations are what an importer can see
+    std::vector<ModuleExport> exports;
+    for (NodeId item : ast.items(ast.root())) {
+        AstKind kind = ast.kind(item);
+        if (kind == AstFunction || kind == AstClass || kind == AstVariable) {
+            exports.push_back({numbers[ast.node(item).a], item});
+        }
+    }
+    std::sort(exports.begin(), exports.end(), [&](const ModuleExport &left, const ModuleExport &right) {
+        return symbols.name(used[left.name - 1]) < symbols.name(used[right.name - 1]);
+    });
+
+    ModuleHeader header = {};
+    std::memcpy(header.magic, ModuleMagic, sizeof(ModuleMagic));
+    header.version = ModuleVersion;
+    header.sourceHash = key.source;
+    header.configHash = key.config;
+    header.sourceSize = key.size;
+    header.nodeCount = static_cast<uint32_t>(local.size());
+    header.extraCount = static_cast<uint32_t>(local.extraSize());
+    header.root = local.root();
+    header.exportCount = static_cast<uint32_t>(exports.size());
+    header.nameCount = static_cast<uint32_t>(nameEnds.size());
+    header.nameBytes = static_cast<uint32_t>(names.size());
+    header.checksum = hashArray(local.nodeData(), local.size(), 0);
+    header.checksum = hashArray(local.extraData(), local.extraSize(), header.checksum);
+    header.checksum = hashArray(exports.data(), exports.size(), header.checksum);
+    header.checksum = hashArray(nameEnds.data(), nameEnds.size(), header.checksum);
+    header.checksum = hashArray(names.data(), names.size(), header.checksum);
+
+    // Written under a temporary name and renamed, so a concurrent run never
+    // maps a half-written module
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writeArray(file, local.nodeData(), local.size());
+        writeArray(file, local.extraData(), local.extraSize());
+        writeArray(file, exports.data(), exports.size());
+        writeArray(file, nameEnds.data(), nameEnds.size());
+        file.write(names.data(), names.size());
+        if (!file) {
+            error = "Could not write the module " + temporary;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    std::error_code code;
+    std::filesystem::rename(temporary, path, code);
+    if (code) {
+        error = "Could not write the module " + path + ": " + code.message();
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Calls f(child) on every node that node refers to, by the layouts in ast.hpp
+template <typename F>
+void forEachChild(const AstNode &node, const uint32_t *extra, F &&f) {
+    auto list = [&](uint32_t start, uint32_t count) {
+        for (uint32_t i = start; i < start + count; ++i) {
+            f(extra[i]);
+        }
+    };
+    switch (node.kind) {
+    case AstProgram:
+    case AstBlock:
+    case AstArray:
+        list(node.a, node.b);
+        break;
+    case AstFunction:
+        f(extra[node.b]);
+        list(node.b + 2, extra[node.b + 1]);
+        break;
+    case AstClass:
+        list(node.b + 2, extra[node.b + 1]);
+        break;
+    case AstVariable:
+        if (extra[node.b + 1] != NoNode) {
+            f(extra[node.b + 1]);
+        }
+        break;
+    case AstIf:
+        f(node.a);
+        f(extra[node.b]);
+        if (extra[node.b + 1] != NoNode) {
+            f(extra[node.b + 1]);
+        }
+        break;
+    case AstFor:
+        list(node.a, 4);
+        break;
+    case AstCall:
+        list(node.b + 1, extra[node.b]);
+        break;
+    case AstExpressionStatement:
+    case AstReturn:
+    case AstOutput:
+        f(node.a);
+        break;
+    case AstWhile:
+    case AstBinary:
+        f(node.a);
+        f(node.b);
+        break;
+    case AstAssign:
+        f(node.b);
+        break;
+    default:
+        break;
+    }
+}
+
+// Calls use(atom) on every name node refers to and declare(atom) on the one
+// it declares, if any
+template <typename Use, typename Declare>
+void forEachName(const AstNode &node, const uint32_t *extra, Use &&use, Declare &&declare) {
+    switch (node.kind) {
+    case AstFunction:
+        declare(node.a);
+        break;
+    case AstClass:
+        declare(node.a);
+        use(extra[node.b]);
+        break;
+    case AstParameter:
+        declare(node.a);
+        if (node.op == AstTypeClass) {
+            use(node.b);
+        }
+        break;
+    case AstVariable:
+        declare(node.a);
+        if (node.op == AstTypeClass) {
+            use(extra[node.b]);
+        }
+        break;
+    case AstName:
+    case AstAssign:
+    case AstCall:
+        use(node.a);
+        break;
+    default:
+        break;
+    }
+}
+
+// Copies the declarations a program needs out of the modules it imports.
+// They are visited depth first from a stack of their own, so whatever a
+// declaration uses is copied in front of it.
+class Linker
+{
+public:
+    Linker(Ast &program, SymbolTable &symbols, const TokenCache *cache, std::string &error)
+        : program(program), symbols(symbols), cache(cache), error(error) {}
+
+    bool run(const std::string &directory) {
+        std::vector<std::pair<size_t, uint32_t>> imports; // Unit and offset of each import
+        for (NodeId item : program.items(program.root())) {
+            const AstNode &node = program.node(item);
+            size_t unit;
+            if (node.kind == AstImport) {
+                if (!open(directory, symbols.name(node.a), unit)) {
+                    return false;
+                }
+                imports.push_back({unit, node.offset});
+            } else if (node.kind == AstFunction || node.kind == AstClass || node.kind == AstVariable) {
+                owners[node.a] = Owned;
+            }
+        }
+        if (imports.empty()) {
+            return true;
+        }
+
+        // Names used but declared nowhere in the program, not even as a local
+        std::vector<uint8_t> names(symbols.size(), 0);
+        for (NodeId id = 1; id < program.size(); ++id) {
+            forEachName(
+                program.node(id), program.extraData(), [&](Atom atom) { names[atom] |= 1; },
+                [&](Atom atom) { names[atom] |= 2; });
+        }
+        for (Atom atom = 1; atom < names.size(); ++atom) {
+            if (names[atom] != 1) {
+                continue;
+            }
+            std::string_view name = symbols.name(atom);
+            for (const auto &from : imports) {
+                NodeId node = units[from.first]->module.find(name);
+                if (node != NoNode) {
+                    if (!need(from.first, node, from.second) || !link()) {
+                        return false;
+                    }
+                    break;
+                }
+            }
+        }
+
+        // The declarations go first, in the order they were copied
+        std::vector<NodeId> items = imported;
+        NodeRange own = program.items(program.root());
+        items.insert(items.end(), own.begin(), own.end());
+        const uint32_t offset = program.node(program.root()).offset;
+        const uint32_t list = program.addExtra(items.data(), items.size());
+        program.setRoot(program.add(AstProgram, offset, list, static_cast<uint32_t>(items.size())));
+        return true;
+    }
+
+private:
+    // A module and the names it has been asked for so far
+    struct Unit
+    {
+        std::string path;
+        std::string directory;
+        Module module;
+        std::vector<size_t> imports; // Its own, by unit
+        bool opened = false;         // Whether imports were opened yet
+        std::unordered_map<uint32_t, Atom> atoms;
+    };
+
+    // A declaration waiting to be copied. Its nodes take the offset of the
+    // program's import that led to it, since they have no source in the program.
+    struct Visit
+    {
+        size_t unit;
+        NodeId node;
+        uint32_t offset;
+        bool expanded; // Whether what it uses has been queued
+    };
+
+    static const uint64_t Owned = ~uint64_t(0); // Owner of the program's own declarations
+
+    Ast &program;
+    SymbolTable &symbols;
+    const TokenCache *cache;
+    std::string &error;
+    std::vector<std::unique_ptr<Unit>> units;
+    std::vector<Visit> pending;
+    std::unordered_set<uint64_t> seen; // By unit and node
+    std::unordered_map<Atom, uint64_t> owners; // Where each top-level name comes from
+    std::vector<NodeId> imported;
+    std::vector<NodeId> nodes; // Of the declaration at hand, in order
+    std::vector<NodeId> stack;
+    std::vector<uint32_t> record;
+
+    bool open(const std::string &directory, std::string_view name, size_t &index) {
+        std::string source = (std::filesystem::path(directory) / (std::string(name) + ".myn")).string();
+        std::string path = modulePath(source);
+        for (index = 0; index < units.size(); ++index) {
+            if (units[index]->path == path) {
+                return true;
+            }
+        }
+        std::unique_ptr<Unit> unit(new Unit());
+        unit->path = path;
+        unit->directory = std::filesystem::path(source).parent_path().string();
+        if (!unit->module.open(path, cache, error)) {
+            error = "Cannot import " + std::string(name) + ": " + error;
+            return false;
+        }
+        units.push_back(std::move(unit));
+        return true;
+    }
+
+    // The imports of a module are only opened once it is asked for a name it
+    // does not declare itself
+    bool importsOf(size_t index) {
+        Unit &unit = *units[index];
+        if (unit.opened) {
+            return true;
+        }
+        unit.opened = true;
+        const AstNode &root = unit.module.nodes()[unit.module.root()];
+        for (uint32_t i = root.a; i < root.a + root.b; ++i) {
+            const AstNode &item = unit.module.nodes()[unit.module.extra()[i]];
+            size_t found;
+            if (item.kind == AstImport) {
+                if (!open(unit.directory, unit.module.name(item.a), found)) {
+                    return false;
+                }
+                unit.imports.push_back(found);
+            }
+        }
+        return true;
+    }
+
+    Atom atom(size_t index, uint32_t local) {
+        if (local == NoAtom) {
+            return NoAtom;
+        }
+        Unit &unit = *units[index];
+        auto entry = unit.atoms.find(local);
+        if (entry != unit.atoms.end()) {
+            return entry->second;
+        }
+        Atom atom = symbols.intern(unit.module.name(local));
+        unit.atoms.emplace(local, atom);
+        return atom;
+    }
+
+    // Queues the declaration node of unit, unless it already was. Its name
+    // must not be taken by anything else.
+    bool need(size_t unit, NodeId node, uint32_t offset) {
+        const uint64_t key = uint64_t(unit) << 32 | node;
+        if (!seen.insert(key).second) {
+            return true;
+        }
+        Atom name = atom(unit, units[unit]->module.nodes()[node].a);
+        auto owner = owners.emplace(name, key);
+        if (!owner.second && owner.first->second != key) {
+            error = "Cannot import " + std::string(symbols.name(name)) + " from " + units[unit]->path +
+                    ": the name is already declared";
+            return false;
+        }
+        pending.push_back({unit, node, offset, false});
+        return true;
+    }
+
+    // Copies everything queued, each declaration after what it uses
+    bool link() {
+        while (!pending.empty()) {
+            if (pending.back().expanded) {
+                Visit done = pending.back();
+                pending.pop_back();
+                imported.push_back(copy(done));
+                continue;
+            }
+            pending.back().expanded = true;
+            const Visit visit = pending.back();
+            if (!importsOf(visit.unit)) {
+                return false;
+            }
+
+            // Names the declaration uses but does not declare itself are
+            // looked up in its own module first, then in the ones it imports
+            const Module &module = units[visit.unit]->module;
+            collect(module, visit.node);
+            std::vector<uint32_t> uses, locals;
+            for (NodeId id : nodes) {
+                forEachName(
+                    module.nodes()[id], module.extra(),
+                    [&](uint32_t local) {
+                        if (local != NoAtom) {
+                            uses.push_back(local);
+                        }
+                    },
+                    [&](uint32_t local) { locals.push_back(local); });
+            }
+            std::sort(uses.begin(), uses.end());
+            uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+            std::sort(locals.begin(), locals.end());
+            for (uint32_t local : uses) {
+                if (std::binary_search(locals.begin(), locals.end(), local)) {
+                    continue;
+                }
+                std::string_view name = module.name(local);
+                NodeId node = module.find(name);
+                size_t unit = visit.unit;
+                for (size_t i = 0; node == NoNode && i < units[visit.unit]->imports.size(); ++i) {
+                    unit = units[visit.unit]->imports[i];
+                    node = units[unit]->module.find(name);
+                }
+                if (node != NoNode && !need(unit, node, visit.offset)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The nodes under root, in increasing order. Children come before their
+    // parents and expressions are contiguous runs, and both stay so.
+    void collect(const Module &module, NodeId root) {
+        nodes.clear();
+        stack.assign(1, root);
+        while (!stack.empty()) {
+            NodeId id = stack.back();
+            stack.pop_back();
+            nodes.push_back(id);
+            forEachChild(module.nodes()[id], module.extra(), [&](NodeId child) { stack.push_back(child); });
+        }
+        std::sort(nodes.begin(), nodes.end());
+    }
+
+    NodeId copy(const Visit &visit) {
+        const Module &module = units[visit.unit]->module;
+        const uint32_t *extra = module.extra();
+        collect(module, visit.node);
+        const NodeId base = static_cast<NodeId>(program.size());
+        auto map = [&](NodeId id) {
+            return id == NoNode ? NoNode
+                                : base + static_cast<NodeId>(std::lower_bound(nodes.begin(), nodes.end(), id) -
+                                                             nodes.begin());
+        };
+        auto list = [&](uint32_t start, uint32_t count) {
+            for (uint32_t i = start; i < start + count; ++i) {
+                record.push_back(map(extra[i]));
+            }
+        };
+
+        for (NodeId id : nodes) {
+            AstNode node = module.nodes()[id];
+            record.clear();
+            switch (node.kind) {
+            case AstBlock:
+            case AstArray:
+                list(node.a, node.b);
+                node.a = program.addExtra(record.data(), record.size());
+                break;
+            case AstFunction:
+            case AstClass:
+                record.push_back(node.kind == AstFunction ? map(extra[node.b]) : atom(visit.unit, extra[node.b]));
+                record.push_back(extra[node.b + 1]);
+                list(node.b + 2, extra[node.b + 1]);
+                node.a = atom(visit.unit, node.a);
+                node.b = program.addExtra(record.data(), record.size());
+                break;
+            case AstVariable:
+                node.a = atom(visit.unit, node.a);
+                node.b = program.addExtra({atom(visit.unit, extra[node.b]), map(extra[node.b + 1])});
+                break;
+            case AstParameter:
+                node.a = atom(visit.unit, node.a);
+                node.b = atom(visit.unit, node.b);
+                break;
+            case AstIf:
+                node.a = map(node.a);
+                node.b = program.addExtra({map(extra[node.b]), map(extra[node.b + 1])});
+                break;
+            case AstFor:
+                list(node.a, 4);
+                node.a = program.addExtra(record.data(), record.size());
+                break;
+            case AstCall:
+                record.push_back(extra[node.b]);
+                list(node.b + 1, extra[node.b]);
+                node.a = atom(visit.unit, node.a);
+                node.b = program.addExtra(record.data(), record.size());
+                break;
+            case AstExpressionStatement:
+            case AstReturn:
+            case AstOutput:
+                node.a = map(node.a);
+                break;
+            case AstWhile:
+            case AstBinary:
+                node.a = map(node.a);
+                node.b = map(node.b);
+                break;
+            case AstAssign:
+                node.a = atom(visit.unit, node.a);
+                node.b = map(node.b);
+                break;
+            case AstString:
+            case AstName:
+                node.a = atom(visit.unit, node.a);
+                break;
+            default:
+                // Literals hold no names and no nodes
+                break;
+            }
+            NodeId added = program.add(node.kind, visit.offset, node.a, node.b, node.op);
+            program.node(added).flags = node.flags;
+        }
+        return static_cast<NodeId>(program.size() - 1);
+    }
+};
+
+} // namespace
+
+bool linkImports(Ast &program, SymbolTable &symbols, const std::string &directory, const TokenCache *cache,
+                 std::string &error) {
+    return Linker(program, symbols, cache, error).run(directory);
+}
@@ -0,0 +1,1006 @@
+#include "optimizer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "vm.hpp"
+
+namespace {
+
+// Rounds of passes before the tree is taken as it is, even if the last one
+// still changed something
+const unsigned MaxRounds = 4;
+
+// Inlining: the most nodes a function's returned expression may have, what
+// one call may grow the program by (twice that in a loop, where calls run
+// most often), and what all of them may together unless a quarter of the
+// program is more
+const size_t InlineBodyLimit = 40;
+const long InlineSiteLimit = 12;
+const size_t InlineBudget = 256;
+
+// The type of an expression nothing is known about; the others are AstTypes
+const uint8_t NoType = 0xFF;
+
+// Work left for the rewriter. Statements nest as deep as the parser allows,
+// so like the compiler it runs off a stack of its own.
+enum TaskKind : uint8_t
+{
+    TaskStatement, // a: node, b: 1 if it has to stay, as a loop initializer does
+    TaskList,      // a: program, block or class, b: next item, c: where its results start
+    TaskEndScope,  // a: locals to keep
+    TaskFunction,  // a: function, c: where its results start
+    TaskIf,        // a: if, c: where its results start
+    TaskWhile,     // a: while, after the body; c: where its results start
+    TaskForHeader, // a: for, once the initializer is done; c: where its results start
+    TaskFor        // a: for, c: where its results start
+};
+
+struct Task
+{
+    TaskKind kind;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+// A rewritten statement, NoNode if it was removed
+struct Result
+{
+    NodeId id;
+    bool returns; // Never finishes other than by returning
+};
+
+// A rewritten expression: its root, and where its run of nodes and extra
+// records starts in the new tree
+struct Operand
+{
+    NodeId id;
+    NodeId first;
+    uint32_t extra;
+    uint8_t type = NoType;
+    bool safe = false;   // Cannot fail or have side effects
+    bool global = false; // Reads a global
+};
+
+struct Local
+{
+    Atom name;
+    uint8_t type;    // AstType
+    NodeId copy;     // Literal or name in the new tree the local always equals, NoNode if none
+    uint32_t source; // For a name, the local it names
+};
+
+// A function as the inliner sees it
+struct Callee
+{
+    NodeId function;
+    NodeId expression = NoNode;  // What its body returns
+    size_t size = 0;             // Nodes in it
+    std::vector<uint32_t> uses;  // Of each parameter in it
+    std::vector<Atom> globals;   // Other names in it
+    bool callsFunctions = false; // In it
+    std::vector<Atom> calls;     // Anywhere in the function
+    bool recursive = false;
+    std::string reason;          // Why it is never inlined, empty if it can be
+};
+
+struct InlineState
+{
+    size_t budget; // Nodes inlining may still add
+    std::vector<InlineDecision> decisions;
+};
+
+// Copies a tree into a new one from the root down, so that nodes nothing
+// refers to any more are left behind, applying one pass on the way. The
+// copy comes out in post-order like the parser's: expressions are rebuilt
+// front to back on an operand stack, and dropping part of one is cutting the
+// end off the new arrays. Classes are copied as they are, since their
+// members are not run yet.
+class Rewriter {
+public:
+    // pass is PassCount for a plain copy. Inlining needs the tree in the
+    // order a rewriter leaves it, every function after the item before it.
+    Rewriter(const Ast &in, Ast &out, SymbolTable &symbols, OptimizationPass pass, InlineState *inlining = nullptr)
+        : in(in), out(out), symbols(symbols), pass(pass), inlining(inlining), reads(symbols.size(), 0),
+          assigns(symbols.size(), 0), declarations(symbols.size(), 0), globalTypes(symbols.size(), NoType) {}
+
+    // Returns the number of rewrites
+    size_t run() {
+        count();
+        out.reserve(in.size());
+        tasks.push_back({TaskStatement, in.root(), 0, 0});
+        while (!tasks.empty()) {
+            Task task = tasks.back();
+            tasks.pop_back();
+            step(task);
+        }
+        return rewrites;
+    }
+
+private:
+    const Ast &in;
+    Ast &out;
+    SymbolTable &symbols;
+    const OptimizationPass pass;
+    InlineState *inlining;
+    size_t rewrites = 0;
+
+    // Uses of each atom anywhere in the old tree
+    std::vector<uint32_t> reads;
+    std::vector<uint32_t> assigns;
+    std::vector<uint32_t> declarations;
+    std::vector<uint8_t> globalTypes; // Declared at the top level
+
+    std::vector<Task> tasks;
+    std::vector<Result> results;
+    std::vector<Operand> operands;
+    std::vector<Local> locals; // Innermost last
+    uint32_t scopeDepth = 0;   // 0 at the top level, where variables are global
+    unsigned classDepth = 0;   // Nothing is rewritten inside a class
+    unsigned loopDepth = 0;
+    bool expanding = false;    // Copying in a function's body, whose calls wait for the next round
+    Atom caller = NoAtom;      // Function being copied
+    std::vector<Callee> callees;
+    std::vector<uint32_t> functionIndex; // By atom, 1 + the index in callees
+    std::vector<uint32_t> record;
+    Heap heap; // Values of literals being folded
+
+    bool active(OptimizationPass which) const { return pass == which && classDepth == 0; }
+
+    void count() {
+        for (NodeId id = 1; id < in.size(); ++id) {
+            const AstNode &node = in.node(id);
+            if (node.kind == AstName) {
+                ++reads[node.a];
+            } else if (node.kind == AstAssign) {
+                ++assigns[node.a];
+            } else if (node.kind == AstVariable || node.kind == AstParameter) {
+                ++declarations[node.a];
+            }
+        }
+        for (NodeId item : in.items(in.root())) {
+            if (in.kind(item) == AstVariable) {
+                globalTypes[in.node(item).a] = known(in.node(item).op);
+            }
+        }
+        if (pass == PassInlining) {
+            collectCallees();
+        }
+    }
+
+    static uint8_t known(uint8_t type) { return type == AstTypeClass ? NoType : type; }
+
+    // A global declared once has the type it was declared with
+    uint8_t globalType(Atom name) const { return declarations[name] == 1 ? globalTypes[name] : NoType; }
+
+    // A node like the old one, with new children
+    NodeId add(const AstNode &like, uint32_t a, uint32_t b) {
+        NodeId id = out.add(like.kind, like.offset, a, b, like.op);
+        out.node(id).flags = like.flags;
+        return id;
+    }
+
+    // Drops everything added to the new tree since it was this size
+    void truncate(NodeId first, uint32_t extra) { out.resize(first, extra); }
+
+    NodeId emptyBlock(uint32_t offset) {
+        return out.add(AstBlock, offset, static_cast<uint32_t>(out.extraSize()), 0);
+    }
+
+    void step(const Task &task) {
+        switch (task.kind) {
+        case TaskStatement:
+            statement(task.a, task.b != 0);
+            break;
+        case TaskList:
+            list(task);
+            break;
+        case TaskEndScope:
+            locals.resize(task.a);
+            --scopeDepth;
+            break;
+        case TaskFunction: {
+            const AstNode &node = in.node(task.a);
+            record.clear();
+            record.push_back(results.back().id);
+            record.push_back(static_cast<uint32_t>(results.size() - task.c - 1));
+            for (size_t i = task.c; i + 1 < results.size(); ++i) {
+                record.push_back(results[i].id);
+            }
+            results.resize(task.c);
+            results.push_back({add(node, node.a, out.addExtra(record.data(), record.size())), false});
+            locals.clear();
+            scopeDepth = 0;
+            caller = NoAtom;
+            break;
+        }
+        case TaskIf: {
+            const AstNode &node = in.node(task.a);
+            const Result *parts = results.data() + task.c;
+            const bool hasElse = results.size() - task.c == 3;
+            NodeId then = parts[1].id != NoNode ? parts[1].id : emptyBlock(node.offset);
+            NodeId otherwise = hasElse ? parts[2].id : NoNode;
+            bool returns = hasElse && parts[1].returns && parts[2].returns;
+            NodeId condition = parts[0].id;
+            results.resize(task.c);
+            results.push_back({add(node, condition, out.addExtra({then, otherwise})), returns});
+            break;
+        }
+        case TaskWhile: {
+            const AstNode &node = in.node(task.a);
+            NodeId condition = results[task.c].id;
+            NodeId body = results[task.c + 1].id != NoNode ? results[task.c + 1].id : emptyBlock(node.offset);
+            results.resize(task.c);
+            results.push_back({add(node, condition, body), false});
+            --loopDepth;
+            break;
+        }
+        case TaskForHeader:
+            forHeader(task);
+            break;
+        case TaskFor: {
+            const AstNode &node = in.node(task.a);
+            const Result *parts = results.data() + task.c;
+            NodeId body = parts[3].id != NoNode ? parts[3].id : emptyBlock(node.offset);
+            uint32_t extra = out.addExtra({parts[0].id, parts[1].id, parts[2].id, body});
+            results.resize(task.c);
+            results.push_back({add(node, extra, 0), false});
+            --loopDepth;
+            break;
+        }
+        }
+    }
+
+    void statement(NodeId id, bool keep) {
+        const AstNode &node = in.node(id);
+        const NodeId first = static_cast<NodeId>(out.size());
+        const uint32_t extra = static_cast<uint32_t>(out.extraSize());
+        switch (node.kind) {
+        case AstProgram:
+            tasks.push_back({TaskList, id, 0, static_cast<uint32_t>(results.size())});
+            break;
+        case AstBlock:
+            ++scopeDepth;
+            tasks.push_back({TaskEndScope, static_cast<uint32_t>(locals.size()), 0, 0});
+            tasks.push_back({TaskList, id, 0, static_cast<uint32_t>(results.size())});
+            break;
+        case AstClass:
+            ++classDepth;
+            tasks.push_back({TaskList, id, 0, static_cast<uint32_t>(results.size())});
+            break;
+        case AstFunction:
+            function(id);
+            break;
+        case AstVariable:
+            variable(id, keep);
+            break;
+        case AstExpressionStatement:
+        case AstReturn:
+        case AstOutput: {
+            Operand value = expression(node.a);
+            if (node.kind == AstExpressionStatement && !keep && active(PassDeadCode) && isLiteral(value.id)) {
+                truncate(first, extra);
+                ++rewrites;
+                results.push_back({NoNode, false});
+            } else {
+                results.push_back({add(node, value.id, 0), node.kind == AstReturn});
+            }
+            break;
+        }
+        case AstIf: {
+            Operand condition = expression(node.a);
+            bool truth;
+            if (active(PassDeadCode) && constant(condition.id, truth)) {
+                // The branch taken stands in for the if
+                truncate(first, extra);
+                ++rewrites;
+                NodeId taken = truth ? in.ifThen(id) : in.ifElse(id);
+                if (taken != NoNode) {
+                    tasks.push_back({TaskStatement, taken, 0, 0});
+                } else {
+                    results.push_back({NoNode, false});
+                }
+                break;
+            }
+            tasks.push_back({TaskIf, id, 0, static_cast<uint32_t>(results.size())});
+            results.push_back({condition.id, false});
+            if (in.ifElse(id) != NoNode) {
+                tasks.push_back({TaskStatement, in.ifElse(id), 0, 0});
+            }
+            tasks.push_back({TaskStatement, in.ifThen(id), 0, 0});
+            break;
+        }
+        case AstWhile: {
+            ++loopDepth;
+            Operand condition = expression(node.a);
+            bool truth;
+            if (active(PassDeadCode) && constant(condition.id, truth) && !truth) {
+                --loopDepth;
+                truncate(first, extra);
+                ++rewrites;
+                results.push_back({NoNode, false});
+                break;
+            }
+            tasks.push_back({TaskWhile, id, 0, static_cast<uint32_t>(results.size())});
+            results.push_back({condition.id, false});
+            tasks.push_back({TaskStatement, node.b, 0, 0});
+            break;
+        }
+        case AstFor:
+            // The initializer's variable belongs to the loop
+            ++scopeDepth;
+            tasks.push_back({TaskEndScope, static_cast<uint32_t>(locals.size()), 0, 0});
+            tasks.push_back({TaskForHeader, id, 0, static_cast<uint32_t>(results.size())});
+            tasks.push_back({TaskStatement, in.forInitializer(id), 1, 0});
+            break;
+        default:
+            // Lazy bodies and anything else without children
+            results.push_back({add(node, node.a, node.b), false});
+            break;
+        }
+    }
+
+    // Queues the next item of a list, or builds the list once they are done.
+    // Nothing after a statement that always returns is ever run.
+    void list(const Task &task) {
+        const AstNode &node = in.node(task.a);
+        NodeRange items = node.kind == AstClass ? in.classMembers(task.a) : in.items(task.a);
+        if (task.b < items.size()) {
+            bool unreachable = node.kind == AstBlock && active(PassDeadCode) && results.size() > task.c &&
+                               results.back().returns;
+            if (!unreachable) {
+                tasks.push_back({TaskList, task.a, task.b + 1, task.c});
+                tasks.push_back({TaskStatement, items.begin()[task.b], 0, 0});
+                return;
+            }
+            rewrites += items.size() - task.b;
+        }
+
+        record.clear();
+        bool returns = false;
+        for (size_t i = task.c; i < results.size(); ++i) {
+            if (results[i].id != NoNode) {
+                record.push_back(results[i].id);
+            }
+            returns |= results[i].returns;
+        }
+        results.resize(task.c);
+        const uint32_t count = static_cast<uint32_t>(record.size());
+        if (node.kind == AstClass) {
+            record.insert(record.begin(), {in.classBase(task.a), count});
+            results.push_back({add(node, node.a, out.addExtra(record.data(), record.size())), false});
+            --classDepth;
+            return;
+        }
+        NodeId id = add(node, out.addExtra(record.data(), record.size()), count);
+        if (node.kind == AstProgram) {
+            out.setRoot(id);
+        }
+        results.push_back({id, node.kind == AstBlock && returns});
+    }
+
+    // Parameters are the first locals of the function
+    void function(NodeId id) {
+        tasks.push_back({TaskFunction, id, 0, static_cast<uint32_t>(results.size())});
+        scopeDepth = 1;
+        caller = in.node(id).a;
+        for (NodeId parameter : in.functionParameters(id)) {
+            const AstNode &node = in.node(parameter);
+            results.push_back({add(node, node.a, node.b), false});
+            locals.push_back({node.a, node.op, NoNode, 0});
+        }
+        tasks.push_back({TaskStatement, in.functionBody(id), 0, 0});
+    }
+
+    void variable(NodeId id, bool keep) {
+        const AstNode &node = in.node(id);
+        const NodeId first = static_cast<NodeId>(out.size());
+        const uint32_t extra = static_cast<uint32_t>(out.extraSize());
+        NodeId initializer = NoNode;
+        if (in.variableInitializer(id) != NoNode) {
+            initializer = expression(in.variableInitializer(id)).id;
+        }
+
+        // A local nothing mentions whose initializer can neither fail nor do
+        // anything goes; one declared twice still has to be reported
+        const bool local = scopeDepth > 0;
+        if (local && !keep && active(PassDeadCode) && reads[node.a] == 0 && assigns[node.a] == 0 &&
+            declarations[node.a] == 1 && initializer != NoNode && fits(initializer, node.op, true)) {
+            truncate(first, extra);
+            ++rewrites;
+            results.push_back({NoNode, false});
+            return;
+        }
+
+        results.push_back({add(node, node.a, out.addExtra({in.variableClass(id), initializer})), false});
+        if (!local) {
+            return;
+        }
+        // Declared after the initializer, which still sees any outer variable
+        Local entry = {node.a, node.op, NoNode, 0};
+        if (active(PassCopyPropagation) && assigns[node.a] == 0 && initializer != NoNode &&
+            fits(initializer, node.op, false)) {
+            entry.copy = initializer;
+            if (out.kind(initializer) == AstName) {
+                entry.source = static_cast<uint32_t>(lookup(out.node(initializer).a));
+            }
+        }
+        locals.push_back(entry);
+    }
+
+    // Whether value, a node of the new tree, can be stored in a variable of
+    // type without a conversion (or, with converting set, with one that
+    // cannot fail). A name has to be a local of the same type that is never
+    // assigned to, so it holds the same value for as long as it is in scope.
+    bool fits(NodeId value, uint8_t type, bool converting) const {
+        switch (out.kind(value)) {
+        case AstInt:
+            return type == AstTypeInt || (converting && type == AstTypeFloat);
+        case AstFloat:
+            return type == AstTypeFloat;
+        case AstString:
+            return type == AstTypeString;
+        case AstBool:
+            return type == AstTypeBool;
+        case AstName: {
+            int index = lookup(out.node(value).a);
+            return type != AstTypeClass && index >= 0 && locals[index].type == type &&
+                   assigns[locals[index].name] == 0;
+        }
+        default:
+            return false;
+        }
+    }
+
+    int lookup(Atom name) const {
+        for (size_t i = locals.size(); i-- > 0;) {
+            if (locals[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    void forHeader(const Task &task) {
+        const NodeId first = static_cast<NodeId>(out.size());
+        const uint32_t extra = static_cast<uint32_t>(out.extraSize());
+        ++loopDepth;
+        Operand condition = expression(in.forCondition(task.a));
+        bool truth;
+        if (active(PassDeadCode) && constant(condition.id, truth) && !truth) {
+            --loopDepth;
+            // Only the initializer runs, in a block of its own for its variable
+            truncate(first, extra);
+            ++rewrites;
+            NodeId initializer = results.back().id;
+            results.back().id = out.add(AstBlock, in.node(task.a).offset, out.addExtra({initializer}), 1);
+            return;
+        }
+        results.push_back({condition.id, false});
+        results.push_back({expression(in.forStep(task.a)).id, false});
+        tasks.push_back({TaskFor, task.a, 0, task.c});
+        tasks.push_back({TaskStatement, in.forBody(task.a), 0, 0});
+    }
+
+    // Sizes up every function for inlining. Only one whose body is a single
+    // return statement can be, since a call is an expression.
+    void collectCallees() {
+        functionIndex.assign(symbols.size(), 0);
+        NodeId previous = NoNode;
+        for (NodeId item : in.items(in.root())) {
+            const AstNode &node = in.node(item);
+            if (node.kind != AstFunction) {
+                previous = item;
+                continue;
+            }
+            if (functionIndex[node.a] != 0) {
+                callees[functionIndex[node.a] - 1].reason = "it is defined more than once";
+                previous = item;
+                continue;
+            }
+            callees.emplace_back();
+            functionIndex[node.a] = static_cast<uint32_t>(callees.size());
+            Callee &callee = callees.back();
+            callee.function = item;
+            // The function's nodes are the ones since the item before it
+            for (NodeId id = previous + 1; id < item; ++id) {
+                if (in.kind(id) == AstCall) {
+                    callee.calls.push_back(in.node(id).a);
+                }
+            }
+            previous = item;
+
+            NodeRange parameters = in.functionParameters(item);
+            callee.uses.assign(parameters.size(), 0);
+            for (NodeId parameter : parameters) {
+                if (in.node(parameter).op == AstTypeClass) {
+                    callee.reason = "it takes an object";
+                }
+            }
+            NodeId body = in.functionBody(item);
+            if (in.kind(body) != AstBlock || in.items(body).size() != 1 || in.kind(*in.items(body).begin()) != AstReturn) {
+                callee.reason = "its body is more than a return statement";
+                continue;
+            }
+            callee.expression = in.node(*in.items(body).begin()).a;
+            for (NodeId id = in.firstNode(callee.expression); id <= callee.expression; ++id) {
+                const AstNode &part = in.node(id);
+                ++callee.size;
+                if (part.kind == AstName) {
+                    int index = parameterIndex(parameters, part.a);
+                    if (index >= 0) {
+                        ++callee.uses[index];
+                    } else {
+                        callee.globals.push_back(part.a);
+                    }
+                } else if (part.kind == AstAssign) {
+                    callee.reason = "it assigns to a variable";
+                } else if (part.kind == AstCall) {
+                    callee.callsFunctions = true;
+                }
+            }
+            if (callee.reason.empty() && callee.size > InlineBodyLimit) {
+                callee.reason = "it returns " + std::to_string(callee.size) + " nodes, over the limit of " +
+                                std::to_string(InlineBodyLimit);
+            }
+        }
+
+        markRecursion();
+        for (Callee &callee : callees) {
+            if (callee.recursive && callee.reason.empty()) {
+                callee.reason = "it is recursive";
+            }
+        }
+    }
+
+    int parameterIndex(NodeRange parameters, Atom name) const {
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            if (in.node(parameters.begin()[i]).a == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Tarjan's algorithm, off a stack of its own: a function is recursive if
+    // its strongly connected component of the call graph has others in it,
+    // or if it calls itself
+    void markRecursion() {
+        const size_t count = callees.size();
+        std::vector<uint32_t> order(count, 0); // When first reached, 0 for not yet
+        std::vector<uint32_t> low(count, 0);
+        std::vector<bool> open(count, false);
+        std::vector<uint32_t> component;
+        std::vector<std::pair<uint32_t, size_t>> frames; // Function, next call
+        uint32_t reached = 0;
+        auto reach = [&](uint32_t function) {
+            order[function] = low[function] = ++reached;
+            component.push_back(function);
+            open[function] = true;
+            frames.push_back({function, 0});
+        };
+
+        for (uint32_t root = 0; root < count; ++root) {
+            if (order[root] != 0) {
+                continue;
+            }
+            reach(root);
+            while (!frames.empty()) {
+                const uint32_t function = frames.back().first;
+                if (frames.back().second < callees[function].calls.size()) {
+                    uint32_t target = functionIndex[callees[function].calls[frames.back().second++]];
+                    if (target-- == 0) {
+                        continue; // Unknown, left for the compiler
+                    }
+                    if (target == function) {
+                        callees[function].recursive = true;
+                    }
+                    if (order[target] == 0) {
+                        reach(target);
+                    } else if (open[target]) {
+                        low[function] = std::min(low[function], order[target]);
+                    }
+                    continue;
+                }
+                frames.pop_back();
+                if (!frames.empty()) {
+                    uint32_t parent = frames.back().first;
+                    low[parent] = std::min(low[parent], low[function]);
+                }
+                if (low[function] == order[function]) {
+                    size_t start = component.size();
+                    while (component[--start] != function) {
+                    }
+                    const bool cycle = component.size() - start > 1;
+                    for (size_t i = start; i < component.size(); ++i) {
+                        open[component[i]] = false;
+                        callees[component[i]].recursive |= cycle;
+                    }
+                    component.resize(start);
+                }
+            }
+        }
+    }
+
+    bool decline(const AstNode &call, const std::string &reason) {
+        inlining->decisions.push_back({call.offset, call.a, caller, false, reason});
+        return false;
+    }
+
+    // Replaces a call, whose arguments are the operands on top, with the
+    // expression the function returns. Each argument is rebuilt from the old
+    // tree wherever its parameter is used, so it has to be free of side
+    // effects and unable to fail, and more than a single node only if it is
+    // used at most once. Returns false to leave the call be.
+    bool inlineCall(NodeId id, const AstNode &node) {
+        const uint32_t index = functionIndex[node.a];
+        const NodeRange arguments = in.callArguments(id);
+        if (index == 0 || in.functionParameters(callees[index - 1].function).size() != arguments.size()) {
+            return false; // For the compiler to report
+        }
+        const Callee &callee = callees[index - 1];
+        if (!callee.reason.empty()) {
+            return decline(node, callee.reason);
+        }
+
+        static const char *const typeNames[] = {"an int", "a float", "a string", "a bool"};
+        const NodeRange parameters = in.functionParameters(callee.function);
+        const Operand *values = operands.data() + operands.size() - arguments.size();
+        // Nodes the body and the arguments in it take, less those of the call
+        long growth = static_cast<long>(callee.size) - 1;
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            const AstNode &parameter = in.node(parameters.begin()[i]);
+            const Operand &value = values[i];
+            const std::string name(symbols.name(parameter.a));
+            if (value.type != parameter.op) {
+                return decline(node, "argument " + name + " is not known to be " + typeNames[parameter.op]);
+            }
+            if (!value.safe || (value.global && callee.callsFunctions)) {
+                return decline(node, "argument " + name + " might fail or have side effects");
+            }
+            const long size = static_cast<long>(value.id - value.first + 1);
+            const long uses = static_cast<long>(callee.uses[i]);
+            if (size > 1 && uses > 1) {
+                return decline(node, "argument " + name + " would be worked out more than once");
+            }
+            growth += (uses - 1) * size - uses;
+        }
+        for (Atom name : callee.globals) {
+            if (lookup(name) >= 0) {
+                return decline(node, std::string(symbols.name(name)) + " is a local variable here");
+            }
+        }
+        const long limit = loopDepth > 0 ? 2 * InlineSiteLimit : InlineSiteLimit;
+        if (growth > limit) {
+            return decline(node, "it would add " + std::to_string(growth) + " nodes, over the limit of " +
+                                     std::to_string(limit));
+        }
+        if (growth > 0 && static_cast<size_t>(growth) > inlining->budget) {
+            return decline(node, "the size budget is spent");
+        }
+        if (growth > 0) {
+            inlining->budget -= static_cast<size_t>(growth);
+        }
+        const long change = growth < 0 ? -growth : growth;
+        inlining->decisions.push_back({node.offset, node.a, caller, true,
+                                       growth == 0 ? std::string("same size")
+                                                   : (growth > 0 ? "adds " : "saves ") + std::to_string(change) +
+                                                         (change == 1 ? " node" : " nodes")});
+
+        if (!arguments.empty()) {
+            truncate(values[0].first, values[0].extra);
+            operands.resize(operands.size() - arguments.size());
+        }
+        expanding = true;
+        for (NodeId part = in.firstNode(callee.expression); part <= callee.expression; ++part) {
+            int parameter = in.kind(part) == AstName ? parameterIndex(parameters, in.node(part).a) : -1;
+            if (parameter < 0) {
+                operation(part);
+                continue;
+            }
+            NodeId argument = arguments.begin()[parameter];
+            for (NodeId at = in.firstNode(argument); at <= argument; ++at) {
+                operation(at);
+            }
+        }
+        expanding = false;
+        ++rewrites;
+        return true;
+    }
+
+    // Rebuilds the expression ending at root, front to back
+    Operand expression(NodeId root) {
+        for (NodeId id = in.firstNode(root); id <= root; ++id) {
+            operation(id);
+        }
+        Operand result = operands.back();
+        operands.pop_back();
+        return result;
+    }
+
+    void operation(NodeId id) {
+        const AstNode &node = in.node(id);
+        const uint32_t extra = static_cast<uint32_t>(out.extraSize());
+        switch (node.kind) {
+        case AstName: {
+            int index = active(PassCopyPropagation) ? lookup(node.a) : -1;
+            if (index >= 0 && locals[index].copy != NoNode) {
+                const AstNode copy = out.node(locals[index].copy);
+                // The original must not be hidden by another variable here
+                if (copy.kind != AstName || lookup(copy.a) == static_cast<int>(locals[index].source)) {
+                    operands.push_back(leaf(out.add(copy.kind, node.offset, copy.a, copy.b, copy.op), extra));
+                    ++rewrites;
+                    break;
+                }
+            }
+            operands.push_back(leaf(add(node, node.a, node.b), extra));
+            break;
+        }
+        case AstAssign: {
+            Operand value = operands.back();
+            operands.back() = {add(node, node.a, value.id), value.first, value.extra};
+            break;
+        }
+        case AstCall:
+        case AstArray: {
+            if (node.kind == AstCall && active(PassInlining) && !expanding && inlineCall(id, node)) {
+                break;
+            }
+            const uint32_t count = static_cast<uint32_t>(node.kind == AstCall ? in.callArguments(id).size() : node.b);
+            const Operand *arguments = operands.data() + operands.size() - count;
+            Operand result = {NoNode, static_cast<NodeId>(out.size()), extra};
+            if (count != 0) {
+                result.first = arguments[0].first;
+                result.extra = arguments[0].extra;
+            }
+            record.clear();
+            if (node.kind == AstCall) {
+                record.push_back(count);
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                record.push_back(arguments[i].id);
+            }
+            uint32_t start = out.addExtra(record.data(), record.size());
+            result.id = node.kind == AstCall ? add(node, node.a, start) : add(node, start, count);
+            operands.resize(operands.size() - count);
+            operands.push_back(result);
+            break;
+        }
+        case AstBinary: {
+            Operand right = operands.back();
+            operands.pop_back();
+            Operand &left = operands.back();
+            NodeId folded = active(PassConstantFolding) ? fold(node, left, right) : NoNode;
+            if (folded != NoNode) {
+                ++rewrites;
+                left = leaf(folded, left.extra);
+                break;
+            }
+            bool fails;
+            left.id = add(node, left.id, right.id);
+            left.type = binaryType(node.op, left.type, right.type, fails);
+            left.safe = left.safe && right.safe && !fails;
+            left.global = left.global || right.global;
+            break;
+        }
+        default:
+            // Literals
+            operands.push_back(leaf(add(node, node.a, node.b), extra));
+            break;
+        }
+    }
+
+    // An operand of a single literal or name of the new tree
+    Operand leaf(NodeId id, uint32_t extra) const {
+        Operand operand = {id, id, extra};
+        const AstNode &node = out.node(id);
+        operand.safe = true;
+        switch (node.kind) {
+        case AstInt:
+            operand.type = AstTypeInt;
+            break;
+        case AstFloat:
+            operand.type = AstTypeFloat;
+            break;
+        case AstString:
+            operand.type = AstTypeString;
+            break;
+        case AstBool:
+            operand.type = AstTypeBool;
+            break;
+        case AstName: {
+            int index = lookup(node.a);
+            operand.type = index >= 0 ? known(locals[index].type) : globalType(node.a);
+            operand.global = index < 0;
+            break;
+        }
+        default:
+            break;
+        }
+        return operand;
+    }
+
+    // The type of left op right as the compiler works it out, and whether
+    // working it out can fail for operands of those types
+    static uint8_t binaryType(uint8_t op, uint8_t left, uint8_t right, bool &fails) {
+        fails = false;
+        if (op == AstAnd || op == AstOr || op == AstEqual || op == AstNotEqual) {
+            return AstTypeBool;
+        }
+        const bool comparison = op >= AstEqual;
+        if ((left == AstTypeInt || left == AstTypeFloat) && (right == AstTypeInt || right == AstTypeFloat)) {
+            if (comparison) {
+                return AstTypeBool;
+            }
+            const bool ints = left == AstTypeInt && right == AstTypeInt;
+            fails = ints && op == AstDivide; // By zero
+            return ints ? AstTypeInt : AstTypeFloat;
+        }
+        if (op == AstAdd && (left == AstTypeString || right == AstTypeString)) {
+            return AstTypeString;
+        }
+        if (comparison && left == AstTypeString && right == AstTypeString) {
+            return AstTypeBool;
+        }
+        fails = true;
+        return comparison ? static_cast<uint8_t>(AstTypeBool) : NoType;
+    }
+
+    bool isLiteral(NodeId id) const {
+        AstKind kind = out.kind(id);
+        return kind == AstInt || kind == AstFloat || kind == AstString || kind == AstBool || kind == AstNull;
+    }
+
+    // The value of a literal in the new tree
+    bool literal(NodeId id, Value &value) {
+        const AstNode &node = out.node(id);
+        switch (node.kind) {
+        case AstInt:
+            value = Value::integer(out.intValue(id));
+            return true;
+        case AstFloat:
+            value = Value::number(out.floatValue(id));
+            return true;
+        case AstString:
+            value = heap.string(std::string(symbols.name(node.a)));
+            return true;
+        case AstBool:
+            value = Value::boolean(node.op != 0);
+            return true;
+        case AstNull:
+            value = Value::null();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool constant(NodeId id, bool &truth) {
+        Value value;
+        if (!literal(id, value)) {
+            return false;
+        }
+        truth = truthy(value);
+        return true;
+    }
+
+    // Replaces left op right, the last two runs of the new tree, with the
+    // literal it evaluates to. Operators are applied by the same code the VM
+    // uses; those that would fail at run time are left for it to report.
+    // Returns NoNode if there is nothing to fold.
+    NodeId fold(const AstNode &node, const Operand &left, const Operand &right) {
+        Value a, b, result;
+        if (!literal(left.id, a)) {
+            return NoNode;
+        }
+        if (node.op == AstAnd || node.op == AstOr) {
+            // A left operand that decides makes the right one dead
+            bool decided = truthy(a) == (node.op == AstOr);
+            if (decided) {
+                result = Value::boolean(node.op == AstOr);
+            } else if (literal(right.id, b)) {
+                result = Value::boolean(truthy(b));
+            } else {
+                return NoNode;
+            }
+        } else {
+            if (!literal(right.id, b)) {
+                return NoNode;
+            }
+            try {
+                result = applyOperator(static_cast<Opcode>(OpAdd + node.op), a, b, heap);
+            } catch (const RuntimeError &) {
+                return NoNode;
+            }
+        }
+        truncate(left.first, left.extra);
+        return literalNode(result, node.offset);
+    }
+
+    NodeId literalNode(Value value, uint32_t offset) {
+        uint32_t low, high;
+        switch (value.type()) {
+        case ValueInt:
+            splitValue(static_cast<uint64_t>(value.asInt()), low, high);
+            return out.add(AstInt, offset, low, high);
+        case ValueFloat: {
+            double number = value.asFloat();
+            uint64_t bits;
+            std::memcpy(&bits, &number, sizeof(bits));
+            splitValue(bits, low, high);
+            return out.add(AstFloat, offset, low, high);
+        }
+        case ValueString:
+            return out.add(AstString, offset, symbols.intern(value.asString()));
+        case ValueBool:
+            return out.add(AstBool, offset, 0, 0, value.asBool());
+        default:
+            return out.add(AstNull, offset);
+        }
+    }
+};
+
+} // namespace
+
+const char *passName(OptimizationPass pass) {
+    static const char *const names[PassCount] = {"constant-folding", "dead-code", "copy-propagation", "inlining"};
+    return pass < PassCount ? names[pass] : "?";
+}
+
+Ast optimizeAst(const Ast &ast, SymbolTable &symbols, unsigned level, OptimizationStats &stats) {
+    stats = OptimizationStats();
+    // A plain copy first leaves out nodes no longer in the tree, such as the
+    // placeholders of bodies parsed lazily, so they do not count as removed
+    Ast current;
+    Rewriter(ast, current, symbols, PassCount).run();
+    stats.nodesBefore = current.size() - 1;
+
+    const unsigned passes = level >= 2 ? PassCount : level == 1 ? PassCopyPropagation : 0;
+    InlineState inlining = {std::max(InlineBudget, stats.nodesBefore / 4), {}};
+    // A call is looked at again every round it survives
+    std::map<std::tuple<uint32_t, Atom, Atom>, InlineDecision> decisions;
+    for (unsigned round = 0; round < MaxRounds && passes != 0; ++round) {
+        size_t rewrites = 0;
+        for (unsigned pass = 0; pass < passes; ++pass) {
+            Ast next;
+            size_t done = Rewriter(current, next, symbols, static_cast<OptimizationPass>(pass), &inlining).run();
+            for (InlineDecision &decision : inlining.decisions) {
+                decisions[std::make_tuple(decision.offset, decision.callee, decision.caller)] = std::move(decision);
+            }
+            inlining.decisions.clear();
+            if (done == 0) {
+                continue;
+            }
+            stats.passes[pass].rewrites += done;
+            stats.passes[pass].nodesRemoved += static_cast<long>(current.size()) - static_cast<long>(next.size());
+            rewrites += done;
+            current = std::move(next);
+        }
+        ++stats.rounds;
+        if (rewrites == 0) {
+            break;
+        }
+    }
+    for (auto &entry : decisions) {
+        stats.inlining.push_back(std::move(entry.second));
+    }
+    stats.nodesAfter = current.size() - 1;
+    return current;
+}
+
+void printOptimizationStats(const OptimizationStats &stats, std::ostream &out) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-20s %10s %14s\n", "pass", "rewrites", "nodes removed");
+    out << line;
+    for (unsigned pass = 0; pass < PassCount; ++pass) {
+        std::snprintf(line, sizeof(line), "%-20s %10zu %14ld\n", passName(static_cast<OptimizationPass>(pass)),
+                      stats.passes[pass].rewrites, stats.passes[pass].nodesRemoved);
+        out << line;
+    }
+    out << "nodes: " << stats.nodesBefore << " -> " << stats.nodesAfter << " in " << stats.rounds
+        << (stats.rounds == 1 ? " round\n" : " rounds\n");
+}
@@ -0,0 +1,116 @@
+#include "lexer.hpp"
+#include "scan.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// Below this a chunk is not worth a task of its own
+const size_t minChunkSize = 256 * 1024;
+
+bool isSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Chooses chunk boundaries close to evenly spaced targets. A pre-pass follows
+// only what can hide code from the lexer (strings and both kinds of comment),
+// and a boundary is placed on whitespace outside of those, where the lexer is
+// always between tokens. The result starts with 0 and ends with the size.
+std::vector<size_t> findChunkBoundaries(std::string_view source, size_t chunks) {
+    const Scanner &scan = scanner();
+    const char *data = source.data();
+    const size_t size = source.size();
+
+    std::vector<size_t> boundaries = {0};
+    size_t target = size / chunks;
+    size_t i = 0;
+
+    while (i < size && boundaries.size() < chunks) {
+        size_t special = scan.stringOrComment(data, size, i);
+
+        // [i, special) is plain code, split it at whitespace past each target
+        while (boundaries.size() < chunks && target < special) {
+            size_t split = std::max(i, target);
+            while (split < special && !isSpace(data[split])) {
+                ++split;
+            }
+            if (split == special) {
+                break; // Try again in the next stretch of plain code
+            }
+            boundaries.push_back(split);
+            target = std::max(split + 1, size / chunks * boundaries.size());
+        }
+
+        if (special == size) {
+            break;
+        }
+
+        // Step over the string or comment exactly the way the lexer would
+        char ch = data[special];
+        if (ch == '\'' || ch == '"') {
+            size_t close = scan.find(data, size, special + 1, ch);
+            i = close == size ? size : close + 1;
+        } else if (ch == '#') {
+            size_t newline = scan.find(data, size, special + 1, '\n');
+            i = newline == size ? size : newline + 1;
+        } else if (special + 1 < size && data[special + 1] == '*') {
+            size_t close = scan.commentEnd(data, size, special + 2);
+            i = close == size ? size : close + 2;
+        } else {
+            i = special + 1; // A plain '/'
+        }
+    }
+
+    boundaries.push_back(size);
+    return boundaries;
+}
+
+} // namespace
+
+TokenBuffer tokenizeParallel(std::string_view sourceCode, SymbolTable &symbols, ThreadPool &pool,
+                             const LexerContext &context) {
+    // Splitting and merging only pay off when chunks really run side by side
+    size_t chunks = std::min(pool.concurrency() * 4, sourceCode.size() / minChunkSize);
+    if (pool.concurrency() < 2 || chunks < 2) {
+        return tokenize(sourceCode, symbols, context);
+    }
+
+    TokenBuffer tokens(sourceCode);
+    std::vector<size_t> boundaries = findChunkBoundaries(sourceCode, chunks);
+    chunks = boundaries.size() - 1;
+
+    // Each chunk interns into a table of its own, so the workers share nothing
+    std::vector<TokenBuffer> chunkTokens(chunks);
+    std::vector<SymbolTable> chunkSymbols(chunks);
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        size_t begin = boundaries[chunk];
+        chunkTokens[chunk] =
+            tokenize(sourceCode.substr(begin, boundaries[chunk + 1] - begin), chunkSymbols[chunk], context);
+    });
+
+    // Merging the tables in chunk order hands out atoms in order of first
+    // occurrence, exactly as a sequential pass would
+    std::vector<std::vector<Atom>> remap(chunks);
+    std::vector<size_t> firstToken(chunks + 1, 0);
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const SymbolTable &local = chunkSymbols[chunk];
+        remap[chunk].resize(local.size(), NoAtom);
+        for (Atom atom = 1; atom < local.size(); ++atom) {
+            remap[chunk][atom] = symbols.intern(local.name(atom));
+        }
+        firstToken[chunk + 1] = firstToken[chunk] + chunkTokens[chunk].size();
+    }
+
+    // Chunk offsets are relative to the chunk, shift them onto the whole source
+    tokens.resize(firstToken[chunks]);
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        const TokenBuffer &local = chunkTokens[chunk];
+        uint32_t shift = static_cast<uint32_t>(boundaries[chunk]);
+        size_t out = firstToken[chunk];
+        for (size_t i = 0; i < local.size(); ++i, ++out) {
+            tokens.set(out, local.type(i), local.offset(i) + shift, local.length(i), remap[chunk][local.atom(i)]);
+        }
+        chunkTokens[chunk] = TokenBuffer();
+    });
+
+    return tokens;
+}
@@ -0,0 +1,116 @@
+#include "parser.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Below this a chunk is not worth a task of its own
+const size_t minChunkTokens = 32 * 1024;
+
+// Token indices that cut the buffer into about chunks ranges. Cuts only go
+// before a `fun` or `class` outside of any brackets: nothing else can start
+// there, so each range parses on its own exactly as it would in place. The
+// pre-pass reads just the kind array.
+std::vector<size_t> findTopLevelCuts(const TokenBuffer &tokens, size_t chunks) {
+    std::vector<size_t> cuts = {0};
+    const size_t target = tokens.size() / chunks;
+    size_t depth = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        switch (tokens.type(i)) {
+        case OpenBrace:
+        case OpenParen:
+        case OpenSBracket:
+            ++depth;
+            break;
+        case CloseBrace:
+        case CloseParen:
+        case CloseSBracket:
+            depth -= depth > 0;
+            break;
+        case Fun:
+        case Class:
+            if (depth == 0 && i - cuts.back() >= target) {
+                cuts.push_back(i);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    cuts.push_back(tokens.size());
+    return cuts;
+}
+
+} // namespace
+
+void Parser::parseParallel(ThreadPool &pool) {
+    assert(tokens != nullptr && frames.empty() && stream.position() == 0 && stream.end() == tokens->size() &&
+           "parseParallel needs a fresh parser over a whole buffer");
+    // Stitching costs a copy of the tree, which only more threads pay back
+    size_t chunks = std::min(pool.concurrency() * 4, tokens->size() / minChunkTokens);
+    if (pool.concurrency() < 2 || chunks < 2) {
+        parse();
+        return;
+    }
+    std::vector<size_t> cuts = findTopLevelCuts(*tokens, chunks);
+    chunks = cuts.size() - 1;
+    if (chunks < 2) {
+        parse();
+        return;
+    }
+
+    // Every range gets a parser, and so a tree, of its own
+    std::vector<std::unique_ptr<Parser>> parts(chunks);
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        parts[chunk].reset(new Parser(*tokens, cuts[chunk], cuts[chunk + 1]));
+        parts[chunk]->setNestingLimit(nestingLimit);
+        parts[chunk]->setLazyBodies(lazyBodies);
+        parts[chunk]->parse();
+    });
+
+    // Diagnostics are rare, and recovery in a range could run into its end
+    // where the whole program would go on; a sequential pass reports them
+    // exactly
+    for (const auto &part : parts) {
+        if (!part->errors.empty()) {
+            parse();
+            return;
+        }
+    }
+
+    // The bodies go one after another, just where a sequential parse would
+    // have put them, followed by the program's list of items
+    std::vector<NodeId> nodeAt(chunks);
+    std::vector<uint32_t> extraAt(chunks);
+    size_t nodeCount = 1;
+    size_t extraCount = 0;
+    size_t itemCount = 0;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const Ast &part = parts[chunk]->tree;
+        nodeAt[chunk] = static_cast<NodeId>(nodeCount);
+        extraAt[chunk] = static_cast<uint32_t>(extraCount);
+        nodeCount += part.bodyNodes();
+        extraCount += part.bodyExtra();
+        itemCount += part.items(part.root()).size();
+    }
+    tree.resize(nodeCount, extraCount);
+
+    // The items are renumbered before the trees are dropped
+    std::vector<NodeId> items;
+    items.reserve(itemCount);
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const Ast &part = parts[chunk]->tree;
+        for (NodeId item : part.items(part.root())) {
+            items.push_back(item + nodeAt[chunk] - 1);
+        }
+    }
+
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        tree.copyBody(parts[chunk]->tree, nodeAt[chunk], extraAt[chunk]);
+        parts[chunk].reset();
+    });
+
+    uint32_t list = tree.addExtra(items.data(), items.size());
+    tree.setRoot(tree.add(AstProgram, tokens->offset(0), list, static_cast<uint32_t>(items.size())));
+}
@@ -1,6 +1,12 @@
 #include "parser.hpp"
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <string>
+#include "value.hpp"
 
 class ParsingException : public std::runtime_error {
 public:
@@ -8,213 +14,683 @@ public:
         : std::runtime_error(message) {}
 };
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), currentIndex(0) {}
+namespace {
+
+// From loosest to tightest: || && (== !=) (< > <= >=) (+ -) (* /)
+bool binaryOperator(const Token &token, AstOperator &op, int &precedence) {
+    std::string_view value = token.value;
+    switch (token.type) {
+    case ArithmeticOperator:
+        switch (value[0]) {
+        case '+': op = AstAdd; precedence = 5; return true;
+        case '-': op = AstSubtract; precedence = 5; return true;
+        case '*': op = AstMultiply; precedence = 6; return true;
+        default: op = AstDivide; precedence = 6; return true;
+        }
+    case ComparisonOperator:
+        if (value == "==" || value == "!=") {
+            op = value[0] == '=' ? AstEqual : AstNotEqual;
+            precedence = 3;
+        } else if (value[0] == '<') {
+            op = value.size() == 1 ? AstLess : AstLessEqual;
+            precedence = 4;
+        } else {
+            op = value.size() == 1 ? AstGreater : AstGreaterEqual;
+            precedence = 4;
+        }
+        return true;
+    case LogicalOperator:
+        op = value[0] == '&' ? AstAnd : AstOr;
+        precedence = value[0] == '&' ? 2 : 1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// How a token is named in diagnostics
+std::string describe(const Token &token) {
+    if (token.type == Invalid) {
+        return "the end of the input";
+    }
+    return "'" + std::string(token.value) + "'";
+}
+
+} // namespace
+
+Parser::Parser(const TokenBuffer& tokens) : tokens(&tokens), ownStream(tokens), stream(ownStream) {
+    tree.reserve(tokens.size());
+}
+
+Parser::Parser(const TokenBuffer& tokens, size_t first, size_t last)
+    : tokens(&tokens), ownStream(tokens, first, last), stream(ownStream) {
+    tree.reserve(last - first);
+}
+
+Parser::Parser(TokenStream& stream) : tokens(nullptr), stream(stream) {}
 
 void Parser::parse() {
-    while (currentIndex < tokens.size()) {
-        parseStatement();
+    push(FrameProgram, offset());
+    run();
+    tree.setRoot(result);
+}
+
+NodeId Parser::materialize(NodeId function) {
+    NodeId body = tree.functionBody(function);
+    const AstNode lazy = tree.node(body);
+    if (lazy.kind != AstLazyBody) {
+        return body;
     }
+    assert(tokens != nullptr && frames.empty());
+
+    // The body is parsed on its own, with the blocks that were around it
+    ownStream = TokenStream(*tokens, lazy.a, lazy.b);
+    blockDepth = lazy.op;
+    openBlock();
+    run();
+    tree.setFunctionBody(function, result);
+    return result;
 }
 
-void Parser::parseStatement() {
-    Token token = currentToken();
-    
-    if (token.type == Fun) {
-            parseFunctionDefinition();
-    } else if (token.type == While) {
-            parseWhileLoop();
-    } else if (token.type == For) {
-            parseForLoop();
-    } else if (token.type == Output) {
-            parseOutputStatement();
-    } else if (token.type == IntType || token.type == StringType || token.type == FloatType || token.type == BooleanType) {
-            parseVariableDeclaration();
-    } else if (token.type == TokenType::Identifier) {
-        parseFunctionCall();  // Assume an identifier followed by `(` is a function call
+// Statements and blocks are driven by this loop rather than by recursion.
+// An error abandons the step it happened in and recovers before the next.
+void Parser::run() {
+    while (!frames.empty()) {
+        size_t savedFrames = frames.size();
+        size_t savedScratch = scratch.size();
+        uint64_t savedConsumed = consumed;
+        try {
+            step();
+        } catch (const ParsingException &) {
+            recover(savedFrames, savedScratch, savedConsumed);
+        }
+    }
+}
+
+// Parses one statement or member, or closes the frame on top. Only list
+// frames (program, block, class) are ever on top here: the others open a
+// block right away and wait for it below.
+void Parser::step() {
+    ParseFrame &frame = frames.back();
+    NodeId done;
+    if (frame.kind == FrameProgram) {
+        if (hasMoreTokens()) {
+            if (currentType() == Fun) {
+                openFunction();
+            } else if (currentType() == Class) {
+                openClass();
+            } else if (currentType() == Import) {
+                scratch.push_back(parseImport());
+            } else {
+                parseStatement();
+            }
+            return;
+        }
+        done = closeList(frame, AstProgram);
+    } else if (frame.kind == FrameBlock) {
+        if (hasMoreTokens() && currentType() != CloseBrace) {
+            parseStatement();
+            return;
+        }
+        closeBrace("'}' to close the block");
+        done = closeList(frame, AstBlock);
+        --blockDepth;
     } else {
-        LOG_ERROR("Unexpected token: " + token.type);
-        exit(0);
+        assert(frame.kind == FrameClass);
+        if (hasMoreTokens() && currentType() != CloseBrace) {
+            parseClassMember(frame);
+            return;
+        }
+        closeBrace("'}' to close the class body");
+        uint32_t count = static_cast<uint32_t>(scratch.size() - frame.mark);
+        done = tree.add(AstClass, frame.offset, frame.a, takeList({frame.b, count}, frame.mark));
+        --blockDepth;
     }
+
+    frames.pop_back();
+    finish(done);
 }
 
-void Parser::parseFunctionDefinition() {
-    advance();  // Skip `fun`
-    Token functionName = currentToken();
+// A finished node may in turn finish the construct waiting on it
+void Parser::finish(NodeId done) {
+    while (done != NoNode && !frames.empty()) {
+        done = deliver(done);
+    }
+    if (frames.empty()) {
+        result = done;
+    }
+}
 
-    if (functionName.type != TokenType::Identifier) {
-        LOG_ERROR("Expected function name after 'fun'");
+// Puts the frames back into a state the loop can continue from after a
+// failed step, then skips to the end of the broken statement: past the next
+// ';', or up to the '}' of the enclosing block. A block inside the statement
+// is skipped as a whole.
+void Parser::recover(size_t savedFrames, size_t savedScratch, uint64_t savedConsumed) {
+    // Drop whatever the step opened, and constructs left waiting for a block
+    // that will not come
+    if (frames.size() > savedFrames) {
+        frames.resize(savedFrames);
+    }
+    while (frames.back().kind > FrameClass) {
+        scratch.resize(frames.back().mark);
+        frames.pop_back();
     }
+    if (scratch.size() > savedScratch) {
+        scratch.resize(savedScratch);
+    }
+    blockDepth = 0;
+    for (const ParseFrame &frame : frames) {
+        blockDepth += frame.kind == FrameBlock || frame.kind == FrameClass;
+    }
+    expressionDepth = 0;
 
-    advance();  // Skip function name
-    if (currentToken().type != OpenParen) {
-        LOG_ERROR("Expected '(' after function name");
-        exit(0);
+    size_t braces = 0;
+    while (hasMoreTokens()) {
+        TokenType type = currentType();
+        if (type == CloseBrace) {
+            if (braces == 0) {
+                break;
+            }
+            advance();
+            if (--braces == 0) {
+                break;
+            }
+            continue;
+        }
+        advance();
+        if (type == OpenBrace) {
+            ++braces;
+        } else if (type == Semicolon && braces == 0) {
+            break;
+        }
     }
 
-    // Skip '(' and parameters parsing (simple for now)
-    while (currentToken().type != CloseParen) {
+    // A stray '}' at the top level would stop the skipping where it started
+    if (consumed == savedConsumed && hasMoreTokens()) {
         advance();
     }
-    advance();  // Skip `)`
+}
 
-    if (currentToken().type != OpenBrace) {
-        LOG_ERROR("Expected '{' after function declaration");
-        exit(0);
+// Hands a finished child to the frame on top. Returns the frame's own node if
+// that completed it, NoNode if it is still going.
+NodeId Parser::deliver(NodeId child) {
+    ParseFrame &frame = frames.back();
+    NodeId node;
+    switch (frame.kind) {
+    case FrameFunction: {
+        uint32_t count = static_cast<uint32_t>(scratch.size() - frame.mark);
+        node = tree.add(AstFunction, frame.offset, frame.a, takeList({child, count}, frame.mark));
+        break;
     }
+    case FrameIf:
+        if (frame.b == NoNode && currentType() == Else) {
+            frame.b = child;
+            advance();
+            openBlock();
+            return NoNode;
+        }
+        if (frame.b == NoNode) {
+            node = tree.add(AstIf, frame.offset, frame.a, tree.addExtra({child, NoNode}));
+        } else {
+            node = tree.add(AstIf, frame.offset, frame.a, tree.addExtra({frame.b, child}));
+        }
+        break;
+    case FrameWhile:
+        node = tree.add(AstWhile, frame.offset, frame.a, child);
+        break;
+    case FrameFor:
+        node = tree.add(AstFor, frame.offset, tree.addExtra({frame.a, frame.b, frame.c, child}));
+        break;
+    default:
+        // Lists just collect their children
+        scratch.push_back(child);
+        return NoNode;
+    }
+    frames.pop_back();
+    return node;
+}
 
-    advance();  // Enter function body
-    while (currentToken().type != CloseBrace) {
-        parseStatement();
+// Parses a statement that needs no frame of its own into scratch, or opens
+// the frame of one that does
+void Parser::parseStatement() {
+    TokenType type = currentType();
+    uint32_t start = offset();
+
+    if (atDeclaration()) {
+        NodeId declaration = parseVariableDeclaration();
+        expect(Semicolon, "';' after the variable declaration");
+        scratch.push_back(declaration);
+    } else if (type == If) {
+        advance();  // Skip `if`
+        expect(OpenParen, "'(' after 'if'");
+        NodeId condition = parseExpression();
+        expect(CloseParen, "')' after the condition");
+        push(FrameIf, start, condition);
+        openBlock();
+    } else if (type == While) {
+        advance();  // Skip `while`
+        expect(OpenParen, "'(' after 'while'");
+        NodeId condition = parseExpression();
+        expect(CloseParen, "')' after the condition");
+        push(FrameWhile, start, condition);
+        openBlock();
+    } else if (type == For) {
+        // for (initializer; condition; step) { statements }
+        // In the grammar for_init_statement ends in a ';' of its own before
+        // the one the for_statement rule asks for; a single ';' is what is meant.
+        advance();  // Skip `for`
+        expect(OpenParen, "'(' after 'for'");
+        NodeId initializer;
+        if (atDeclaration()) {
+            initializer = parseVariableDeclaration();
+        } else {
+            uint32_t initializerStart = offset();
+            NodeId expression = parseExpression();
+            initializer = tree.add(AstExpressionStatement, initializerStart, expression);
+        }
+        expect(Semicolon, "';' after the loop initializer");
+        NodeId condition = parseExpression();
+        expect(Semicolon, "';' after the loop condition");
+        NodeId step = parseExpression();
+        expect(CloseParen, "')' after the loop header");
+        push(FrameFor, start, initializer, condition, step);
+        openBlock();
+    } else if (type == Return) {
+        scratch.push_back(parseReturnStatement());
+    } else if (type == Output) {
+        scratch.push_back(parseOutputStatement());
+    } else if (type == OpenBrace) {
+        openBlock();
+    } else {
+        // Anything else has to be an expression
+        NodeId expression = parseExpression();
+        expect(Semicolon, "';' after the expression");
+        scratch.push_back(tree.add(AstExpressionStatement, start, expression));
     }
-    advance();  // Skip `}`
 }
 
-void Parser::parseFunctionCall() {
-    Token functionName = currentToken();
-    advance();  // Skip function name
+// fun name(type name, ...) { statements }
+void Parser::openFunction() {
+    uint32_t start = offset();
+    advance();  // Skip `fun`
+    Atom name = expectName("a function name after 'fun'");
+    expect(OpenParen, "'(' after the function name");
 
-    if (currentToken().type != OpenParen) {
-        LOG_ERROR("Expected '(' for function call");
-        exit(0);
+    // The parameters go below the body's statements in scratch
+    push(FrameFunction, start, name);
+    if (currentType() != CloseParen) {
+        scratch.push_back(parseParameter());
+        while (currentType() == Comma) {
+            advance();
+            scratch.push_back(parseParameter());
+        }
     }
+    expect(CloseParen, "')' after the parameters");
+    if (!skipBody()) {
+        openBlock();
+    }
+}
 
-    // Skip '(' and arguments parsing (simple for now)
-    while (currentToken().type != TokenType::Semicolon) {
-        advance();
+// In lazy mode, steps over the body of the function being opened and finishes
+// it with a placeholder. Bodies that would be rejected before any of their
+// statements are parsed eagerly, so the error shows up right away.
+bool Parser::skipBody() {
+    if (!lazyBodies || tokens == nullptr || currentType() != OpenBrace ||
+        (nestingLimit != 0 && blockDepth >= nestingLimit)) {
+        return false;
+    }
+
+    // Reads just the kind array. Functions do not nest, so every token is
+    // matched over at most once.
+    size_t open = stream.position();
+    size_t depth = 0;
+    for (size_t i = open; i < stream.end(); ++i) {
+        TokenType type = tokens->type(i);
+        if (type == OpenBrace) {
+            ++depth;
+        } else if (type == CloseBrace && --depth == 0) {
+            uint32_t start = offset();
+            stream.seek(i + 1);
+            finish(tree.add(AstLazyBody, start, static_cast<uint32_t>(open), static_cast<uint32_t>(i + 1),
+                            static_cast<uint8_t>(blockDepth)));
+            return true;
+        }
     }
-    advance();  // Skip `)`
+    return false; // Unbalanced, let the parser report where
 }
 
-void Parser::parseWhileLoop() {
-    advance();  // Skip `while`
-    if (currentToken().type != TokenType::OpenParen) {
-        LOG_ERROR("Expected '(' after 'while'");
-        exit(0);
+NodeId Parser::parseParameter() {
+    uint32_t start = offset();
+    uint8_t type;
+    Atom className;
+    parseType(type, className);
+    Atom name = expectName("a parameter name after its type");
+    return tree.add(AstParameter, start, name, className, type);
+}
+
+// class name(base) { public: members private: variables }
+void Parser::openClass() {
+    uint32_t start = offset();
+    advance();  // Skip `class`
+    Atom name = expectName("a class name after 'class'");
+    expect(OpenParen, "'(' after the class name");
+    Atom base = expectName("a base class name");
+    expect(CloseParen, "')' after the base class");
+    if (nestingLimit != 0 && blockDepth >= nestingLimit) {
+        fail("Blocks are nested deeper than the limit of " + std::to_string(nestingLimit));
     }
+    expect(OpenBrace, "'{' to open the class body");
+    ++blockDepth;
+    push(FrameClass, start, name, base, Invalid); // No section seen yet
+}
 
-    // Skip '(' and condition parsing (simple for now)
-    while (currentToken().type != TokenType::CloseParen) {
+void Parser::parseClassMember(ParseFrame &frame) {
+    TokenType access = static_cast<TokenType>(frame.c);
+    if (currentType() == Public || currentType() == Private) {
+        frame.c = currentType();
         advance();
+        expect(Colon, "':' after the access specifier");
+    } else if (access == Invalid) {
+        fail("Expected 'public:' or 'private:' before the class members");
+    } else if (currentType() == Fun) {
+        if (access == Private) {
+            fail("Member functions must be public");
+        }
+        openFunction();
+    } else if (atDeclaration()) {
+        NodeId member = parseVariableDeclaration();
+        expect(Semicolon, "';' after the member declaration");
+        if (access == Private) {
+            tree.node(member).flags |= AstPrivate;
+        }
+        scratch.push_back(member);
+    } else {
+        fail("Unexpected " + describe(currentToken()) + " in the class body");
+    }
+}
+
+void Parser::openBlock() {
+    if (nestingLimit != 0 && blockDepth >= nestingLimit) {
+        fail("Blocks are nested deeper than the limit of " + std::to_string(nestingLimit));
     }
-    advance();  // Skip `)`
+    uint32_t start = offset();
+    expect(OpenBrace, "'{' to open a block");
+    ++blockDepth;
+    push(FrameBlock, start);
+}
 
-    if (currentToken().type != TokenType::OpenBrace) {
-        LOG_ERROR("Expected '{' after while condition");
-        exit(0);
+void Parser::push(ParseFrameKind kind, uint32_t offset, uint32_t a, uint32_t b, uint32_t c) {
+    frames.push_back(ParseFrame{kind, offset, static_cast<uint32_t>(scratch.size()), a, b, c});
+}
+
+NodeId Parser::closeList(const ParseFrame &frame, AstKind kind) {
+    uint32_t count = static_cast<uint32_t>(scratch.size() - frame.mark);
+    return tree.add(kind, frame.offset, takeList({}, frame.mark), count);
+}
+
+// type name = expression, without the ';' so that for loops can share it
+NodeId Parser::parseVariableDeclaration() {
+    uint32_t start = offset();
+    uint8_t type;
+    Atom className;
+    parseType(type, className);
+    Atom name = expectName("a variable name after its type");
+    expect(AssignmentOperator, "'=' after the variable name");
+    NodeId initializer = parseExpression();
+    return tree.add(AstVariable, start, name, tree.addExtra({className, initializer}), type);
+}
+
+NodeId Parser::parseReturnStatement() {
+    uint32_t start = offset();
+    advance();  // Skip `return`
+    NodeId value = parseExpression();
+    expect(Semicolon, "';' after the return value");
+    return tree.add(AstReturn, start, value);
+}
+
+// import name;
+NodeId Parser::parseImport() {
+    uint32_t start = offset();
+    advance();  // Skip `import`
+    Atom name = expectName("a module name after 'import'");
+    expect(Semicolon, "';' after the import");
+    return tree.add(AstImport, start, name);
+}
+
+NodeId Parser::parseOutputStatement() {
+    uint32_t start = offset();
+    advance();  // Skip `output`
+    expect(OpenParen, "'(' after 'output'");
+    NodeId value = parseExpression();
+    expect(CloseParen, "')' after the output value");
+    expect(Semicolon, "';' after the output statement");
+    return tree.add(AstOutput, start, value);
+}
+
+// Precedence climbing: one loop per call handles every operator at or above
+// minPrecedence, and recursing only for a tighter right operand keeps all
+// operators left-associative. Nodes come out in post-order as they complete.
+NodeId Parser::parseExpression(int minPrecedence) {
+    if (++expressionDepth > ExpressionNestingLimit) {
+        fail("Expression is nested deeper than the limit of " + std::to_string(ExpressionNestingLimit));
+    }
+    NodeId left = parsePrimary();
+    AstOperator op;
+    int precedence;
+    while (binaryOperator(currentToken(), op, precedence) && precedence >= minPrecedence) {
+        uint32_t start = offset();
+        advance();
+        NodeId right = parseExpression(precedence + 1);
+        left = tree.add(AstBinary, start, left, right, op);
     }
+    --expressionDepth;
+    return left;
+}
 
-    advance();  // Enter while loop body
-    while (currentToken().type != TokenType::CloseBrace) {
-        parseStatement();
+NodeId Parser::parsePrimary() {
+    uint32_t start = offset();
+    const Token &token = currentToken();
+
+    switch (token.type) {
+    case IntNumber: {
+        const char *end = token.value.data() + token.value.size();
+        int64_t value;
+        auto result = std::from_chars(token.value.data(), end, value);
+        // Ints are 48 bits wide at run time
+        if (result.ec != std::errc() || result.ptr != end || value > Value::MaxInt) {
+            fail("Integer literal out of range: " + std::string(token.value));
+        }
+        uint32_t low, high;
+        splitValue(static_cast<uint64_t>(value), low, high);
+        advance();
+        return tree.add(AstInt, start, low, high);
+    }
+    case FloatNumber: {
+        std::string text(token.value);
+        char *end;
+        double value = std::strtod(text.c_str(), &end);
+        if (end != text.c_str() + text.size()) {
+            fail("Malformed number: " + std::string(token.value));
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t low, high;
+        splitValue(bits, low, high);
+        advance();
+        return tree.add(AstFloat, start, low, high);
+    }
+    case String: {
+        Atom contents = token.atom;
+        advance();
+        return tree.add(AstString, start, contents);
+    }
+    case True:
+    case False: {
+        uint8_t value = token.type == True;
+        advance();
+        return tree.add(AstBool, start, 0, 0, value);
+    }
+    case Null:
+        advance();
+        return tree.add(AstNull, start);
+    case OpenSBracket:
+        return parseArray();
+    case OpenParen: {
+        // Grouping needs no node of its own
+        advance();
+        NodeId inner = parseExpression();
+        expect(CloseParen, "')' to close the parenthesized expression");
+        return inner;
+    }
+    case Identifier: {
+        if (stream.type(1) == OpenParen) {
+            return parseFunctionCall();
+        }
+        Atom name = token.atom;
+        if (stream.type(1) == AssignmentOperator) {
+            advance();
+            advance();  // Skip `=`
+            NodeId value = parseExpression();
+            return tree.add(AstAssign, start, name, value);
+        }
+        advance();
+        return tree.add(AstName, start, name);
+    }
+    default:
+        fail("Expected an expression, found " + describe(token));
     }
-    advance();  // Skip `}`
 }
 
-void Parser::parseForLoop() {
-    advance();  // Skip `for`
-    if (currentToken().type != OpenBrace) {
-        LOG_ERROR("Expected '(' after 'for'");
-        exit(0);
+// name(argument, ...)
+NodeId Parser::parseFunctionCall() {
+    uint32_t start = offset();
+    Atom name = currentToken().atom;
+    advance();  // Skip the function name
+    advance();  // Skip `(`
+
+    size_t mark = scratch.size();
+    if (currentType() != CloseParen) {
+        scratch.push_back(parseExpression());
+        while (currentType() == Comma) {
+            advance();
+            scratch.push_back(parseExpression());
+        }
     }
+    expect(CloseParen, "')' after the arguments");
+
+    uint32_t count = static_cast<uint32_t>(scratch.size() - mark);
+    return tree.add(AstCall, start, name, takeList({count}, mark));
+}
 
-    // Skip '(' and loop header parsing (simple for now)
-    while (currentToken().type != OpenParen) {
+// [expression, ...]
+NodeId Parser::parseArray() {
+    uint32_t start = offset();
+    advance();  // Skip `[`
+
+    size_t mark = scratch.size();
+    scratch.push_back(parseExpression());
+    while (currentType() == Comma) {
         advance();
+        scratch.push_back(parseExpression());
     }
-    advance();  // Skip `)`
+    expect(CloseSBracket, "']' after the array elements");
+
+    uint32_t count = static_cast<uint32_t>(scratch.size() - mark);
+    return tree.add(AstArray, start, takeList({}, mark), count);
+}
 
-    if (currentToken().type != OpenBrace) {
-        LOG_ERROR("Expected '{' after for loop header");
-        exit(0);
+// A built-in type keyword, or a class name followed by the declared name
+bool Parser::atDeclaration() {
+    switch (currentType()) {
+    case IntType:
+    case FloatType:
+    case StringType:
+    case BooleanType:
+        return true;
+    case Identifier:
+        return stream.type(1) == Identifier;
+    default:
+        return false;
     }
+}
 
-    advance();  // Enter for loop body
-    while (currentToken().type != CloseBrace) {
-        parseStatement();
+void Parser::parseType(uint8_t &type, Atom &className) {
+    className = NoAtom;
+    switch (currentType()) {
+    case IntType: type = AstTypeInt; break;
+    case FloatType: type = AstTypeFloat; break;
+    case StringType: type = AstTypeString; break;
+    case BooleanType: type = AstTypeBool; break;
+    case Identifier:
+        type = AstTypeClass;
+        className = currentToken().atom;
+        break;
+    default:
+        fail("Expected a type (int, float, string, bool or a class name), found " + describe(currentToken()));
     }
-    advance();  // Skip `}`
+    advance();
 }
 
-Token Parser::currentToken() const {
-    return tokens[currentIndex];
+// The input may end before a block does; that is reported and the block
+// closed anyway
+void Parser::closeBrace(const char *what) {
+    if (currentType() == CloseBrace) {
+        advance();
+    } else {
+        errors.error(location(), std::string("Expected ") + what + ", found " + describe(currentToken()));
+    }
 }
 
-void Parser::advance() {
-    if (currentIndex < tokens.size()) {
-        currentIndex++;
+void Parser::fail(const std::string &message) {
+    errors.error(location(), message);
+    throw ParsingException(message);
+}
+
+void Parser::expect(TokenType type, const char *what) {
+    if (currentType() != type) {
+        fail(std::string("Expected ") + what + ", found " + describe(currentToken()));
+    }
+    advance();
+}
+
+Atom Parser::expectName(const char *what) {
+    if (currentType() != Identifier) {
+        fail(std::string("Expected ") + what + ", found " + describe(currentToken()));
     }
+    Atom name = currentToken().atom;
+    advance();
+    return name;
 }
 
-void Parser::parseVariableDeclaration() {
-    // Check if the current token is a reserved type
-    if (currentToken().type == TokenType::IntType ||
-        currentToken().type == TokenType::FloatType ||
-        currentToken().type == TokenType::StringType ||
-        currentToken().type == TokenType::BooleanType) {
-        
-        std::string typeName = currentToken().value; // Assuming 'value' holds the string representation of the type
-        advance(); // Move to the next token
+uint32_t Parser::takeList(std::initializer_list<uint32_t> head, size_t mark) {
+    uint32_t start = tree.addExtra(head);
+    tree.addExtra(scratch.data() + mark, scratch.size() - mark);
+    scratch.resize(mark);
+    return start;
+}
 
-        if (currentToken().type != TokenType::Identifier) {
-            LOG_ERROR("Expected variable name after type declaration");
-            exit(0);
-        }
+const Token &Parser::currentToken() {
+    return stream.peek();
+}
 
-        std::string variableName = currentToken().value; // Assuming 'value' holds the identifier name
-        advance(); // Move to the next token
+TokenType Parser::currentType() {
+    return stream.type();
+}
 
-        // Handle the rest of the variable declaration (e.g., assignment)
-    } else {
-        LOG_ERROR("Expected a type declaration (int, float, string, bool)");
-        exit(0);
-    }
-}
-
-void Parser::parseOutputStatement() {
-    // Ensure the current token is the 'output' keyword
-    if (currentToken().type == TokenType::Output) {
-        advance();  // Move to '('
-        
-        if (currentToken().type == TokenType::OpenParen) {
-            advance();  // Move to the string or variable
-            
-            if (currentToken().type == TokenType::String) {
-                std::string outputString = currentToken().value; // Assuming 'value' holds the string content
-                advance();  // Move to ')'
-                
-                if (currentToken().type == TokenType::CloseParen) {
-                    advance();  // Safely advance to the next token
-                    
-                    // Handle optional semicolon
-                    if (!hasMoreTokens()) {
-                        LOG_ERROR("Semicolon missing after output statement");
-                        exit(0);
-                    } else if (currentToken().type == TokenType::Semicolon) {
-                        advance();  // Consume the semicolon if present
-                    } else {
-                        LOG_WARNING("Semicolon missing after output statement");
-                        exit(0);
-                    }
-                    return;
-                } else {
-                    LOG_ERROR("Expected ')' after string in output statement.");
-                    exit(0);
-                }
-            } else {
-                LOG_ERROR("Expected a string in output statement.");
-                exit(0);
-            }
-        } else {
-            LOG_ERROR("Expected '(' after output keyword.");
-            exit(0);
-        }
-    } else {
-        LOG_ERROR("Unexpected token: " + currentToken().value); // Assuming 'value' holds the string representation of the token
-        exit(0);
-    }
+uint32_t Parser::offset() {
+    return stream.offset();
+}
+
+SourceLocation Parser::location() {
+    return stream.location();
+}
+
+void Parser::advance() {
+    stream.advance();
+    ++consumed;
 }
 
 // Function to check if there are more tokens to process
 bool Parser::hasMoreTokens() {
-    return currentIndex < tokens.size();
+    return !stream.atEnd();
 }
@@ -0,0 +1,302 @@
+#include "scan.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MYN_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::array<bool, 256> buildDelimiterTable() {
+    std::array<bool, 256> table{};
+    const char delimiters[] = " \t\n\r'\"#()[]{}+-*/=;,:!&|<>";
+    for (size_t i = 0; i + 1 < sizeof(delimiters); ++i) {
+        table[static_cast<unsigned char>(delimiters[i])] = true;
+    }
+    return table;
+}
+
+constexpr std::array<bool, 256> delimiterTable = buildDelimiterTable();
+
+inline bool delimiter(char ch) {
+    return delimiterTable[static_cast<unsigned char>(ch)];
+}
+
+inline bool space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Scalar versions, also used for the tails of the vector loops
+
+size_t wordScalar(const char *data, size_t size, size_t from) {
+    while (from < size && !delimiter(data[from])) {
+        ++from;
+    }
+    return from;
+}
+
+size_t spaceScalar(const char *data, size_t size, size_t from) {
+    while (from < size && space(data[from])) {
+        ++from;
+    }
+    return from;
+}
+
+size_t findScalar(const char *data, size_t size, size_t from, char ch) {
+    while (from < size && data[from] != ch) {
+        ++from;
+    }
+    return from;
+}
+
+size_t commentEndScalar(const char *data, size_t size, size_t from) {
+    while (from + 1 < size && !(data[from] == '*' && data[from + 1] == '/')) {
+        ++from;
+    }
+    return from + 1 < size ? from : size;
+}
+
+inline bool opensStringOrComment(char ch) {
+    return ch == '\'' || ch == '"' || ch == '#' || ch == '/';
+}
+
+size_t stringOrCommentScalar(const char *data, size_t size, size_t from) {
+    while (from < size && !opensStringOrComment(data[from])) {
+        ++from;
+    }
+    return from;
+}
+
+#ifdef MYN_SCAN_X86
+
+// Candidate bits are verified against the table; the vector test only has to
+// be a cheap superset of the delimiters
+inline size_t firstDelimiter(const char *data, size_t at, uint32_t candidates) {
+    while (candidates != 0) {
+        unsigned bit = __builtin_ctz(candidates);
+        if (delimiter(data[at + bit])) {
+            return at + bit;
+        }
+        candidates &= candidates - 1;
+    }
+    return SIZE_MAX;
+}
+
+// Every delimiter is either <= '/', in ':'..'>' or in '{'..'}' once or-ing
+// 0x20 has folded '['..']' onto that range. Each range is one unsigned min.
+inline __m128i delimiterCandidates(__m128i bytes) {
+    __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8('/')), bytes);
+    __m128i fromColon = _mm_sub_epi8(bytes, _mm_set1_epi8(':'));
+    __m128i punct = _mm_cmpeq_epi8(_mm_min_epu8(fromColon, _mm_set1_epi8('>' - ':')), fromColon);
+    __m128i fromBrace = _mm_sub_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8('{'));
+    __m128i braces = _mm_cmpeq_epi8(_mm_min_epu8(fromBrace, _mm_set1_epi8('}' - '{')), fromBrace);
+    return _mm_or_si128(_mm_or_si128(low, punct), braces);
+}
+
+inline __m128i spaceBytes(__m128i bytes) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+                        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+}
+
+size_t wordSSE2(const char *data, size_t size, size_t from) {
+    while (from + 16 <= size) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        uint32_t mask = _mm_movemask_epi8(delimiterCandidates(bytes));
+        size_t hit = firstDelimiter(data, from, mask);
+        if (hit != SIZE_MAX) {
+            return hit;
+        }
+        from += 16;
+    }
+    return wordScalar(data, size, from);
+}
+
+size_t spaceSSE2(const char *data, size_t size, size_t from) {
+    while (from + 16 <= size) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        uint32_t mask = ~_mm_movemask_epi8(spaceBytes(bytes)) & 0xFFFF;
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 16;
+    }
+    return spaceScalar(data, size, from);
+}
+
+size_t findSSE2(const char *data, size_t size, size_t from, char ch) {
+    __m128i needle = _mm_set1_epi8(ch);
+    while (from + 16 <= size) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 16;
+    }
+    return findScalar(data, size, from, ch);
+}
+
+size_t commentEndSSE2(const char *data, size_t size, size_t from) {
+    __m128i star = _mm_set1_epi8('*');
+    __m128i slash = _mm_set1_epi8('/');
+    while (from + 17 <= size) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from + 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, star),
+                                                        _mm_cmpeq_epi8(second, slash)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 16;
+    }
+    return commentEndScalar(data, size, from);
+}
+
+inline __m128i stringOrCommentBytes(__m128i bytes) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'))),
+                        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('#')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('/'))));
+}
+
+size_t stringOrCommentSSE2(const char *data, size_t size, size_t from) {
+    while (from + 16 <= size) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        uint32_t mask = _mm_movemask_epi8(stringOrCommentBytes(bytes));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 16;
+    }
+    return stringOrCommentScalar(data, size, from);
+}
+
+__attribute__((target("avx2"))) inline __m256i delimiterCandidates256(__m256i bytes) {
+    __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8('/')), bytes);
+    __m256i fromColon = _mm256_sub_epi8(bytes, _mm256_set1_epi8(':'));
+    __m256i punct = _mm256_cmpeq_epi8(_mm256_min_epu8(fromColon, _mm256_set1_epi8('>' - ':')), fromColon);
+    __m256i fromBrace = _mm256_sub_epi8(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('{'));
+    __m256i braces = _mm256_cmpeq_epi8(_mm256_min_epu8(fromBrace, _mm256_set1_epi8('}' - '{')), fromBrace);
+    return _mm256_or_si256(_mm256_or_si256(low, punct), braces);
+}
+
+__attribute__((target("avx2"))) inline __m256i spaceBytes256(__m256i bytes) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))),
+                           _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+}
+
+__attribute__((target("avx2"))) size_t wordAVX2(const char *data, size_t size, size_t from) {
+    while (from + 32 <= size) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        uint32_t mask = _mm256_movemask_epi8(delimiterCandidates256(bytes));
+        size_t hit = firstDelimiter(data, from, mask);
+        if (hit != SIZE_MAX) {
+            return hit;
+        }
+        from += 32;
+    }
+    return wordSSE2(data, size, from);
+}
+
+__attribute__((target("avx2"))) size_t spaceAVX2(const char *data, size_t size, size_t from) {
+    while (from + 32 <= size) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(spaceBytes256(bytes)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 32;
+    }
+    return spaceSSE2(data, size, from);
+}
+
+__attribute__((target("avx2"))) size_t findAVX2(const char *data, size_t size, size_t from, char ch) {
+    __m256i needle = _mm256_set1_epi8(ch);
+    while (from + 32 <= size) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 32;
+    }
+    return findSSE2(data, size, from, ch);
+}
+
+__attribute__((target("avx2"))) size_t commentEndAVX2(const char *data, size_t size, size_t from) {
+    __m256i star = _mm256_set1_epi8('*');
+    __m256i slash = _mm256_set1_epi8('/');
+    while (from + 33 <= size) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from + 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, star),
+                                                              _mm256_cmpeq_epi8(second, slash)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 32;
+    }
+    return commentEndSSE2(data, size, from);
+}
+
+__attribute__((target("avx2"))) size_t stringOrCommentAVX2(const char *data, size_t size, size_t from) {
+    while (from + 32 <= size) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\'')),
+                                                       _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'))),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('#')),
+                                                       _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/'))));
+        uint32_t mask = _mm256_movemask_epi8(hits);
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+        from += 32;
+    }
+    return stringOrCommentSSE2(data, size, from);
+}
+
+#endif // MYN_SCAN_X86
+
+const Scanner scalarScanner = {wordScalar, spaceScalar, findScalar, commentEndScalar, stringOrCommentScalar,
+                                "scalar"};
+#ifdef MYN_SCAN_X86
+const Scanner sse2Scanner = {wordSSE2, spaceSSE2, findSSE2, commentEndSSE2, stringOrCommentSSE2, "sse2"};
+const Scanner avx2Scanner = {wordAVX2, spaceAVX2, findAVX2, commentEndAVX2, stringOrCommentAVX2, "avx2"};
+#endif
+
+const Scanner &selectScanner() {
+    const char *forced = std::getenv("MYN_SIMD");
+    if (forced != nullptr && std::strcmp(forced, "scalar") == 0) {
+        return scalarScanner;
+    }
+#ifdef MYN_SCAN_X86
+    if (forced != nullptr && std::strcmp(forced, "sse2") == 0) {
+        return sse2Scanner;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2Scanner;
+    }
+    return sse2Scanner; // Always there on x86-64
+#else
+    return scalarScanner;
+#endif
+}
+
+} // namespace
+
+const Scanner &scanner() {
+    static const Scanner &selected = selectScanner();
+    return selected;
+}
+
+bool isWordDelimiter(char ch) {
+    return delimiter(ch);
+}
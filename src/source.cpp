@@ -0,0 +1,123 @@
+#include "source.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::~SourceFile() {
+    close();
+}
+
+void SourceFile::close() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char *>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer.clear();
+}
+
+#ifdef _WIN32
+
+bool SourceFile::open(const std::string &path, std::string &error) {
+    close();
+
+    // No mmap here, read the file in one go
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "Could not open the file " + path;
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+bool SourceFile::readAll(int, std::string &) {
+    return false;
+}
+
+#else
+
+bool SourceFile::open(const std::string &path, std::string &error) {
+    close();
+
+    if (path == "-") {
+        return readAll(STDIN_FILENO, error);
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Could not open the file " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            ::close(fd);
+            return true; // mmap refuses empty mappings, an empty view is enough
+        }
+
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // The lexer makes a single forward pass, let the kernel read ahead
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            ::close(fd);
+            data = static_cast<const char *>(mapping);
+            size = info.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+
+    // Not a regular file, or mmap failed: fall back to read()
+    bool ok = readAll(fd, error);
+    ::close(fd);
+    return ok;
+}
+
+bool SourceFile::readAll(int fd, std::string &error) {
+    const size_t chunkSize = 64 * 1024;
+    size_t length = 0;
+
+    for (;;) {
+        if (buffer.size() - length < chunkSize) {
+            buffer.resize(buffer.size() + chunkSize * (1 + buffer.size() / chunkSize / 2));
+        }
+        ssize_t n = ::read(fd, &buffer[length], buffer.size() - length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = std::string("An I/O error occurred while reading: ") + std::strerror(errno);
+            buffer.clear();
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += static_cast<size_t>(n);
+    }
+
+    buffer.resize(length);
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "symbols.hpp"
+#include <cstring>
+
+namespace {
+
+// FNV-1a, plenty for identifier-sized keys
+uint32_t hashName(std::string_view text) {
+    uint32_t hash = 2166136261u;
+    for (char ch : text) {
+        hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+SymbolTable::SymbolTable() : names(1), hashes(1, 0), slots(1024, NoAtom) {}
+
+Atom SymbolTable::find(std::string_view text) const {
+    uint32_t hash = hashName(text);
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        Atom atom = slots[slot];
+        if (atom == NoAtom) {
+            return NoAtom;
+        }
+        if (hashes[atom] == hash && names[atom] == text) {
+            return atom;
+        }
+    }
+}
+
+Atom SymbolTable::intern(std::string_view text) {
+    uint32_t hash = hashName(text);
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    for (;; slot = (slot + 1) & mask) {
+        Atom atom = slots[slot];
+        if (atom == NoAtom) {
+            break;
+        }
+        if (hashes[atom] == hash && names[atom] == text) {
+            return atom;
+        }
+    }
+
+    Atom atom = static_cast<Atom>(names.size());
+    names.push_back(arena.copy(text));
+    hashes.push_back(hash);
+    slots[slot] = atom;
+
+    // Keep the load factor under one half
+    if (names.size() * 2 > slots.size()) {
+        grow();
+    }
+    return atom;
+}
+
+void SymbolTable::grow() {
+    std::vector<Atom> larger(slots.size() * 2, NoAtom);
+    size_t mask = larger.size() - 1;
+    for (Atom atom = 1; atom < names.size(); ++atom) {
+        size_t slot = hashes[atom] & mask;
+        while (larger[slot] != NoAtom) {
+            slot = (slot + 1) & mask;
+        }
+        larger[slot] = atom;
+    }
+    slots.swap(larger);
+}
+
+SymbolTable &globalSymbols() {
+    static SymbolTable symbols;
+    return symbols;
+}
@@ -0,0 +1,84 @@
+#include "thread_pool.hpp"
+#include <atomic>
+
+ThreadPool::ThreadPool(size_t threads) {
+    // The caller of parallelFor counts as one of the threads
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    // Every participant claims indices from a shared counter until none are left
+    std::atomic<size_t> nextIndex(0);
+    std::mutex doneMutex;
+    std::condition_variable allDone;
+    size_t helpers = std::min(count - 1, workers.size());
+    size_t running = helpers;
+
+    auto drain = [&] {
+        for (size_t i = nextIndex++; i < count; i = nextIndex++) {
+            task(i);
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < helpers; ++i) {
+            jobs.push([&] {
+                drain();
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (--running == 0) {
+                    allDone.notify_one();
+                }
+            });
+        }
+    }
+    wakeUp.notify_all();
+
+    drain();
+    std::unique_lock<std::mutex> lock(doneMutex);
+    allDone.wait(lock, [&] { return running == 0; });
+}
+
+ThreadPool &sharedThreadPool() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
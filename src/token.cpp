@@ -0,0 +1,94 @@
+#include "token.hpp"
+#include "scan.hpp"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+static_assert(Invalid <= UINT8_MAX, "token kinds are stored in a byte");
+
+namespace {
+
+// Overwrites what it can in place and inserts or erases only the difference
+template <typename T>
+void replaceRange(std::vector<T> &values, size_t first, size_t count, const std::vector<T> &replacement) {
+    size_t common = std::min(count, replacement.size());
+    std::copy(replacement.begin(), replacement.begin() + common, values.begin() + first);
+    if (count > common) {
+        values.erase(values.begin() + first + common, values.begin() + first + count);
+    } else {
+        values.insert(values.begin() + first + common, replacement.begin() + common, replacement.end());
+    }
+}
+
+} // namespace
+
+SourceLocation LineIndex::locate(uint32_t offset) const {
+    if (lineStarts.empty()) {
+        const Scanner &scan = scanner();
+        const char *data = source.data();
+        const size_t size = source.size();
+
+        lineStarts.push_back(0);
+        for (size_t i = scan.find(data, size, 0, '\n'); i < size; i = scan.find(data, size, i + 1, '\n')) {
+            lineStarts.push_back(static_cast<uint32_t>(i + 1));
+        }
+    }
+
+    // The last line starting at or before offset
+    auto line = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - 1;
+    return {static_cast<uint32_t>(line - lineStarts.begin() + 1), offset - *line + 1};
+}
+
+TokenBuffer::TokenBuffer(std::string_view source) : text(source), lines(source) {
+    if (source.size() > MaxSourceSize) {
+        throw std::length_error("source is larger than 4 GiB");
+    }
+}
+
+void TokenBuffer::reserve(size_t count) {
+    kinds.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+    atoms.reserve(count);
+}
+
+void TokenBuffer::resize(size_t count) {
+    kinds.resize(count);
+    offsets.resize(count);
+    lengths.resize(count);
+    atoms.resize(count);
+}
+
+void TokenBuffer::push(const Token &token) {
+    assert(token.value.data() >= text.data() && token.value.data() + token.value.size() <= text.data() + text.size());
+    kinds.push_back(static_cast<uint8_t>(token.type));
+    offsets.push_back(static_cast<uint32_t>(token.value.data() - text.data()));
+    lengths.push_back(static_cast<uint32_t>(token.value.size()));
+    atoms.push_back(token.atom);
+}
+
+void TokenBuffer::splice(size_t first, size_t count, const TokenBuffer &replacement, int64_t shift) {
+    assert(first + count <= size());
+    if (replacement.text.size() > MaxSourceSize) {
+        throw std::length_error("source is larger than 4 GiB");
+    }
+
+    replaceRange(kinds, first, count, replacement.kinds);
+    replaceRange(offsets, first, count, replacement.offsets);
+    replaceRange(lengths, first, count, replacement.lengths);
+    replaceRange(atoms, first, count, replacement.atoms);
+
+    // Unsigned wraparound makes this a subtraction for negative shifts
+    uint32_t delta = static_cast<uint32_t>(shift);
+    for (size_t i = first + replacement.size(); i < offsets.size(); ++i) {
+        offsets[i] += delta;
+    }
+
+    text = replacement.text;
+    lines = LineIndex(text);
+}
+
+size_t TokenBuffer::memoryUsage() const {
+    return kinds.capacity() * sizeof(uint8_t) + offsets.capacity() * sizeof(uint32_t) +
+           lengths.capacity() * sizeof(uint32_t) + atoms.capacity() * sizeof(Atom);
+}
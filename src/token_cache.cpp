@@ -0,0 +1,307 @@
+#include "token_cache.hpp"
+#include "module.hpp"
+#include "source.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bumped whenever the layout below changes. The number of token types is
+// mixed in as well, since entries store TokenType values.
+const uint32_t CacheFormat = 1;
+const uint32_t CacheVersion = CacheFormat << 8 | Invalid;
+const char CacheMagic[8] = {'M', 'Y', 'N', 'T', 'O', 'K', 'E', 'N'};
+
+// The entry starts with this, followed by
+//   uint8_t  kinds[tokenCount], padded to a multiple of 4
+//   uint32_t offsets[tokenCount]
+//   uint32_t lengths[tokenCount]
+//   uint32_t atoms[tokenCount]      0, or 1 + an index into the names
+//   uint32_t nameEnds[nameCount]    end of each name in the name bytes
+//   char     names[nameBytes]
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t sourceHash;
+    uint64_t configHash;
+    uint64_t sourceSize;
+    uint64_t tokenCount;
+    uint64_t nameCount;
+    uint64_t nameBytes;
+};
+
+uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+uint64_t rotateLeft(uint64_t value, unsigned bits) {
+    return value << bits | value >> (64 - bits);
+}
+
+size_t paddedTo4(size_t size) {
+    return (size + 3) & ~size_t(3);
+}
+
+template <typename T>
+void writeArray(std::ofstream &file, const T *values, size_t count) {
+    file.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+}
+
+} // namespace
+
+uint64_t hashBytes(std::string_view bytes, uint64_t seed) {
+    const char *data = bytes.data();
+    size_t size = bytes.size();
+    uint64_t hash = mix(seed ^ size ^ 0x2545F4914F6CDD1Dull);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = rotateLeft(hash ^ mix(word), 27) * 0x9E3779B97F4A7C15ull + 0x52DCE729ull;
+    }
+    uint64_t tail = 0;
+    if (i < size) {
+        std::memcpy(&tail, data + i, size - i);
+    }
+    return mix(hash ^ mix(tail));
+}
+
+uint64_t hashConfig(const std::unordered_map<std::string, std::string> &config) {
+    std::vector<std::pair<std::string, std::string>> entries(config.begin(), config.end());
+    std::sort(entries.begin(), entries.end());
+
+    std::string text;
+    for (const auto &entry : entries) {
+        text += entry.first;
+        text += '=';
+        text += entry.second;
+        text += '\n';
+    }
+    return hashBytes(text);
+}
+
+CacheKey cacheKey(std::string_view source, uint64_t configHash, uint64_t nestingLimit) {
+    // A tree stored under a looser limit would let a deeper one through
+    return {hashBytes(source), mix(configHash ^ mix(nestingLimit)), source.size()};
+}
+
+std::string TokenCache::defaultDirectory() {
+    if (const char *directory = std::getenv("MYN_CACHE_DIR")) {
+        return directory;
+    }
+    if (const char *cache = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(cache) + "/myn";
+    }
+    if (const char *home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/myn";
+    }
+    return ".myn-cache";
+}
+
+std::string TokenCache::entryPath(const CacheKey &key, const char *extension) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%016llx.%s", static_cast<unsigned long long>(key.source),
+                  static_cast<unsigned long long>(key.config), extension);
+    return directory + "/" + name;
+}
+
+std::string TokenCache::trustPath(uint64_t stamp) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.trust", static_cast<unsigned long long>(stamp));
+    return directory + "/" + name;
+}
+
+bool TokenCache::load(const CacheKey &key, std::string_view source, SymbolTable &symbols, TokenBuffer &tokens,
+                      Ast &ast) const {
+    // The tokens go first: their names are interned in the order the lexer
+    // met them, and the tree's are all among them
+    TokenBuffer loaded;
+    if (!loadTokens(key, source, symbols, loaded)) {
+        return false;
+    }
+    Module tree;
+    std::string error;
+    if (!tree.open(entryPath(key, "ast"), this, error) || !tree.matches(key)) {
+        return false;
+    }
+    tokens = std::move(loaded);
+    ast = tree.toAst(symbols);
+    return true;
+}
+
+bool TokenCache::store(const CacheKey &key, const TokenBuffer &tokens, const Ast &ast, const SymbolTable &symbols,
+                       std::string &error) const {
+    std::error_code code;
+    std::filesystem::create_directories(directory, code);
+    if (code) {
+        error = "Could not create the cache directory " + directory + ": " + code.message();
+        return false;
+    }
+    // Either half missing makes the entry miss, so the order does not matter.
+    // The tree is checked right away, while this run pays for a parse anyway,
+    // so the loads that follow skip that.
+    Module tree;
+    return storeTokens(key, tokens, symbols, error) && writeModule(entryPath(key, "ast"), ast, symbols, key, error) &&
+           tree.open(entryPath(key, "ast"), this, error);
+}
+
+bool TokenCache::trusts(uint64_t stamp) const {
+    std::error_code code;
+    return std::filesystem::exists(trustPath(stamp), code);
+}
+
+void TokenCache::trust(uint64_t stamp) const {
+    std::error_code code;
+    std::filesystem::create_directories(directory, code);
+    std::ofstream(trustPath(stamp), std::ios::binary | std::ios::trunc);
+}
+
+bool TokenCache::loadTokens(const CacheKey &key, std::string_view source, SymbolTable &symbols,
+                            TokenBuffer &tokens) const {
+    SourceFile entry;
+    std::string error;
+    if (!entry.open(entryPath(key, "tok"), error)) {
+        return false;
+    }
+
+    std::string_view bytes = entry.text();
+    CacheHeader header;
+    if (bytes.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion ||
+        header.sourceHash != key.source || header.configHash != key.config || header.sourceSize != key.size ||
+        header.sourceSize != source.size()) {
+        return false;
+    }
+
+    // Every count must fit the file before anything is read
+    const uint64_t count = header.tokenCount;
+    const uint64_t limit = bytes.size();
+    if (count > limit || header.nameCount > limit || header.nameBytes > limit) {
+        return false;
+    }
+    const size_t kindsAt = sizeof(header);
+    const size_t offsetsAt = kindsAt + paddedTo4(count);
+    const size_t lengthsAt = offsetsAt + count * 4;
+    const size_t atomsAt = lengthsAt + count * 4;
+    const size_t nameEndsAt = atomsAt + count * 4;
+    const size_t namesAt = nameEndsAt + header.nameCount * 4;
+    if (namesAt + header.nameBytes != limit) {
+        return false;
+    }
+
+    // Names are interned in the order they were first used, which gives a
+    // fresh table the very atoms the lexer handed out
+    const char *data = bytes.data();
+    std::vector<Atom> atoms(header.nameCount + 1, NoAtom);
+    uint32_t nameStart = 0;
+    for (uint64_t i = 0; i < header.nameCount; ++i) {
+        uint32_t nameEnd;
+        std::memcpy(&nameEnd, data + nameEndsAt + i * 4, 4);
+        if (nameEnd < nameStart || nameEnd > header.nameBytes) {
+            return false;
+        }
+        atoms[i + 1] = symbols.intern(std::string_view(data + namesAt + nameStart, nameEnd - nameStart));
+        nameStart = nameEnd;
+    }
+
+    TokenBuffer loaded(source);
+    loaded.resize(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint8_t kind = static_cast<uint8_t>(data[kindsAt + i]);
+        uint32_t offset, length, atom;
+        std::memcpy(&offset, data + offsetsAt + i * 4, 4);
+        std::memcpy(&length, data + lengthsAt + i * 4, 4);
+        std::memcpy(&atom, data + atomsAt + i * 4, 4);
+        if (kind > Invalid || offset > source.size() || length > source.size() - offset ||
+            atom > header.nameCount) {
+            return false;
+        }
+        loaded.set(i, static_cast<TokenType>(kind), offset, length, atoms[atom]);
+    }
+
+    tokens = std::move(loaded);
+    return true;
+}
+
+bool TokenCache::storeTokens(const CacheKey &key, const TokenBuffer &tokens, const SymbolTable &symbols,
+                             std::string &error) const {
+    // Only the names these tokens use, numbered in order of first use
+    const size_t count = tokens.size();
+    std::vector<uint8_t> kinds(paddedTo4(count), 0);
+    std::vector<uint32_t> offsets(count), lengths(count), atoms(count);
+    std::vector<uint32_t> local(symbols.size(), 0);
+    std::vector<uint32_t> nameEnds;
+    std::string names;
+    for (size_t i = 0; i < count; ++i) {
+        kinds[i] = static_cast<uint8_t>(tokens.type(i));
+        offsets[i] = tokens.offset(i);
+        lengths[i] = tokens.length(i);
+
+        Atom atom = tokens.atom(i);
+        if (atom != NoAtom && local[atom] == 0) {
+            names += symbols.name(atom);
+            nameEnds.push_back(static_cast<uint32_t>(names.size()));
+            local[atom] = static_cast<uint32_t>(nameEnds.size());
+        }
+        atoms[i] = local[atom];
+    }
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.sourceHash = key.source;
+    header.configHash = key.config;
+    header.sourceSize = key.size;
+    header.tokenCount = count;
+    header.nameCount = nameEnds.size();
+    header.nameBytes = names.size();
+
+    // Written under a temporary name and renamed, so a concurrent run never
+    // maps a half-written entry
+    std::string path = entryPath(key, "tok");
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writeArray(file, kinds.data(), kinds.size());
+        writeArray(file, offsets.data(), count);
+        writeArray(file, lengths.data(), count);
+        writeArray(file, atoms.data(), count);
+        writeArray(file, nameEnds.data(), nameEnds.size());
+        file.write(names.data(), names.size());
+        if (!file) {
+            error = "Could not write the cache entry " + temporary;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    std::error_code code;
+    std::filesystem::rename(temporary, path, code);
+    if (code) {
+        error = "Could not write the cache entry " + path + ": " + code.message();
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+#include "value.hpp"
+#include <cstdio>
+
+Heap::Heap(Heap &&other) noexcept
+    : objects(std::move(other.objects)), allocated(other.allocated), limit(other.limit) {
+    other.objects.clear();
+}
+
+Heap &Heap::operator=(Heap &&other) noexcept {
+    if (this != &other) {
+        clear();
+        objects = std::move(other.objects);
+        other.objects.clear();
+        allocated = other.allocated;
+        limit = other.limit;
+    }
+    return *this;
+}
+
+Heap::~Heap() {
+    clear();
+}
+
+void Heap::clear() {
+    for (Object *object : objects) {
+        destroy(object);
+    }
+    objects.clear();
+}
+
+Value Heap::string(std::string text) {
+    StringObject *object = new StringObject{{ValueString, false}, std::move(text)};
+    objects.push_back(object);
+    allocated += sizeof(StringObject) + object->text.capacity();
+    return Value::object(object);
+}
+
+Value Heap::array(const Value *items, size_t count) {
+    ArrayObject *object = new ArrayObject{{ValueArray, false}, std::vector<Value>(items, items + count)};
+    objects.push_back(object);
+    allocated += sizeof(ArrayObject) + count * sizeof(Value);
+    return Value::object(object);
+}
+
+// Works off a stack of its own, since arrays can nest as deep as memory allows
+void Heap::mark(Value value) {
+    if (value.type() < ValueString || value.asObject()->marked) {
+        return;
+    }
+    value.asObject()->marked = true;
+    pending.push_back(value.asObject());
+    while (!pending.empty()) {
+        const Object *object = pending.back();
+        pending.pop_back();
+        if (object->type != ValueArray) {
+            continue;
+        }
+        for (Value item : static_cast<const ArrayObject *>(object)->items) {
+            if (item.type() >= ValueString && !item.asObject()->marked) {
+                item.asObject()->marked = true;
+                pending.push_back(item.asObject());
+            }
+        }
+    }
+}
+
+void Heap::sweep() {
+    size_t live = 0;
+    size_t kept = 0;
+    for (Object *object : objects) {
+        if (object->marked) {
+            object->marked = false;
+            live += footprint(object);
+            objects[kept++] = object;
+        } else {
+            destroy(object);
+        }
+    }
+    objects.resize(kept);
+    allocated = 0;
+    limit = 2 * live > MinLimit ? 2 * live : MinLimit;
+}
+
+size_t Heap::footprint(const Object *object) {
+    if (object->type == ValueString) {
+        return sizeof(StringObject) + static_cast<const StringObject *>(object)->text.capacity();
+    }
+    return sizeof(ArrayObject) + static_cast<const ArrayObject *>(object)->items.capacity() * sizeof(Value);
+}
+
+void Heap::destroy(Object *object) {
+    if (object->type == ValueString) {
+        delete static_cast<StringObject *>(object);
+    } else {
+        delete static_cast<ArrayObject *>(object);
+    }
+}
+
+const char *valueTypeName(ValueType type) {
+    static const char *const names[] = {"NULL", "bool", "int", "float", "string", "array"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+bool truthy(Value value) {
+    switch (value.type()) {
+    case ValueNull:
+        return false;
+    case ValueBool:
+        return value.asBool();
+    case ValueInt:
+        return value.asInt() != 0;
+    case ValueFloat:
+        return value.asFloat() != 0;
+    case ValueString:
+        return !value.asString().empty();
+    default:
+        return true;
+    }
+}
+
+bool equal(Value left, Value right) {
+    if (left.raw() == right.raw() && !left.isFloat()) {
+        return true; // NaN is the one float unequal to itself
+    }
+    if (left.isInt() && right.isInt()) {
+        return left.asInt() == right.asInt();
+    }
+    if ((left.isInt() || left.isFloat()) && (right.isInt() || right.isFloat())) {
+        double a = left.isInt() ? static_cast<double>(left.asInt()) : left.asFloat();
+        double b = right.isInt() ? static_cast<double>(right.asInt()) : right.asFloat();
+        return a == b;
+    }
+    if (left.type() != right.type()) {
+        return false;
+    }
+    switch (left.type()) {
+    case ValueNull:
+        return true;
+    case ValueBool:
+        return left.asBool() == right.asBool();
+    case ValueString:
+        return left.asString() == right.asString();
+    default:
+        return left.asObject() == right.asObject();
+    }
+}
+
+void appendValue(std::string &out, Value value) {
+    char number[32];
+    switch (value.type()) {
+    case ValueNull:
+        out += "NULL";
+        return;
+    case ValueBool:
+        out += value.asBool() ? "true" : "false";
+        return;
+    case ValueInt:
+        std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(value.asInt()));
+        out += number;
+        return;
+    case ValueFloat:
+        std::snprintf(number, sizeof(number), "%.15g", value.asFloat());
+        out += number;
+        return;
+    case ValueString:
+        out += value.asString();
+        return;
+    case ValueArray:
+        out += '[';
+        for (size_t i = 0; i < value.asArray().size(); ++i) {
+            if (i != 0) {
+                out += ", ";
+            }
+            appendValue(out, value.asArray()[i]);
+        }
+        out += ']';
+        return;
+    }
+}
@@ -0,0 +1,584 @@
+#include "vm.hpp"
+
+#if defined(__GNUC__)
+#define MYN_THREADED 1
+#else
+#define MYN_THREADED 0
+#endif
+
+namespace {
+
+// Output is handed to the stream once this much has piled up
+const size_t OutputChunk = 64 * 1024;
+
+int64_t wrap(uint64_t value) {
+    return static_cast<int64_t>(value);
+}
+
+[[noreturn]] void typeError(const char *operation, Value left, Value right) {
+    throw RuntimeError(std::string("cannot ") + operation + ' ' + valueTypeName(left.type()) + " and " +
+                       valueTypeName(right.type()));
+}
+
+double toFloat(Value value) {
+    return value.isInt() ? static_cast<double>(value.asInt()) : value.asFloat();
+}
+
+bool isNumber(Value value) {
+    return value.isInt() || value.isFloat();
+}
+
+// Ints wrap around at 48 bits. Sums, differences and quotients of 48-bit
+// operands fit in 64 bits, so only the product needs unsigned arithmetic to
+// stay defined; Value::integer() then keeps the low 48 bits.
+Value intProduct(Value left, Value right) {
+    return Value::integer(wrap(static_cast<uint64_t>(left.asInt()) * static_cast<uint64_t>(right.asInt())));
+}
+
+Value intQuotient(Value left, Value right) {
+    if (right.asInt() == 0) {
+        throw RuntimeError("division by zero");
+    }
+    return Value::integer(left.asInt() / right.asInt());
+}
+
+Value intArithmetic(Opcode op, Value left, Value right) {
+    switch (op) {
+    case OpAdd:
+        return Value::integer(left.asInt() + right.asInt());
+    case OpSubtract:
+        return Value::integer(left.asInt() - right.asInt());
+    case OpMultiply:
+        return intProduct(left, right);
+    default:
+        return intQuotient(left, right);
+    }
+}
+
+// Everything the generic handlers do not do inline: floats, mixed operands,
+// strings and errors
+Value arithmetic(Opcode op, Value left, Value right, Heap &heap) {
+    if (op == OpAdd && (left.isString() || right.isString())) {
+        std::string text;
+        appendValue(text, left);
+        appendValue(text, right);
+        return heap.string(std::move(text));
+    }
+
+    static const char *const verbs[] = {"add", "subtract", "multiply", "divide"};
+    if (!isNumber(left) || !isNumber(right)) {
+        typeError(verbs[op - OpAdd], left, right);
+    }
+    if (left.isInt() && right.isInt()) {
+        return intArithmetic(op, left, right);
+    }
+
+    double a = toFloat(left);
+    double b = toFloat(right);
+    switch (op) {
+    case OpAdd:
+        return Value::number(a + b);
+    case OpSubtract:
+        return Value::number(a - b);
+    case OpMultiply:
+        return Value::number(a * b);
+    default:
+        return Value::number(a / b);
+    }
+}
+
+bool compare(Opcode op, Value left, Value right) {
+    int order;
+    if (left.isInt() && right.isInt()) {
+        order = left.asInt() < right.asInt() ? -1 : left.asInt() > right.asInt();
+    } else if (isNumber(left) && isNumber(right)) {
+        double a = toFloat(left);
+        double b = toFloat(right);
+        if (a != a || b != b) {
+            return false; // NaN is unordered
+        }
+        order = a < b ? -1 : a > b;
+    } else if (left.isString() && right.isString()) {
+        order = left.asString().compare(right.asString());
+    } else {
+        typeError("compare", left, right);
+    }
+
+    switch (op) {
+    case OpLess:
+        return order < 0;
+    case OpGreater:
+        return order > 0;
+    case OpLessEqual:
+        return order <= 0;
+    default:
+        return order >= 0;
+    }
+}
+
+// Whether value can be stored where type is declared; ints become floats
+bool conform(Value &value, ValueType type) {
+    if (value.type() == type) {
+        return true;
+    }
+    if (type == ValueFloat && value.isInt()) {
+        value = Value::number(static_cast<double>(value.asInt()));
+        return true;
+    }
+    return false;
+}
+
+[[noreturn]] void conformError(ValueType type, Value value) {
+    throw RuntimeError(std::string("expected ") + valueTypeName(type) + ", not " + valueTypeName(value.type()));
+}
+
+bool isFalse(Value value) {
+    return value.isBool() ? !value.asBool() : !truthy(value);
+}
+
+} // namespace
+
+Value applyOperator(Opcode op, Value left, Value right, Heap &heap) {
+    switch (op) {
+    case OpEqual:
+        return Value::boolean(equal(left, right));
+    case OpNotEqual:
+        return Value::boolean(!equal(left, right));
+    case OpLess:
+    case OpGreater:
+    case OpLessEqual:
+    case OpGreaterEqual:
+        return Value::boolean(compare(op, left, right));
+    default:
+        return arithmetic(op, left, right, heap);
+    }
+}
+
+VM::VM(const Bytecode &program, std::ostream &out)
+    : program(program), out(out), stack(new Value[StackSize]), frames(new CallFrame[MaxCallDepth]) {}
+
+// Only the handlers that allocate call this, right after the new object is on
+// the stack, so every value still in use is below sp or in a global.
+// Constants belong to the program's heap and are never freed.
+void VM::collect(const Value *sp) {
+    for (const Value *value = stack.get(); value != sp; ++value) {
+        heap.mark(*value);
+    }
+    for (Value value : globals) {
+        heap.mark(value);
+    }
+    heap.sweep();
+}
+
+void VM::flush() {
+    out.write(output.data(), output.size());
+    output.clear();
+}
+
+void VM::run() {
+#if MYN_THREADED
+    static const void *const handlers[OpcodeCount] = {
+#define MYN_OPCODE_HANDLER(name, operands, effect) &&Op##name##Handler,
+        MYN_OPCODES(MYN_OPCODE_HANDLER)
+#undef MYN_OPCODE_HANDLER
+    };
+#define DISPATCH()                                                                                              \
+    do {                                                                                                        \
+        ++count;                                                                                                \
+        goto *(pc++)->handler;                                                                                  \
+    } while (0)
+#define TARGET(name) Op##name##Handler:
+#else
+#define DISPATCH()                                                                                              \
+    do {                                                                                                        \
+        ++count;                                                                                                \
+        goto dispatch;                                                                                          \
+    } while (0)
+#define TARGET(name) case Op##name:
+#endif
+#define OPERAND() ((pc++)->operand)
+
+    if (code.empty()) {
+        code.resize(program.code.size());
+        for (size_t at = 0; at < program.code.size();) {
+            Opcode op = static_cast<Opcode>(program.code[at]);
+#if MYN_THREADED
+            code[at].handler = handlers[op];
+#else
+            code[at].operand = op;
+#endif
+            for (unsigned i = 1; i <= opcodeOperands(op); ++i) {
+                code[at + i].operand = program.code[at + i];
+            }
+            at += 1 + opcodeOperands(op);
+        }
+    }
+    globals = program.globals;
+
+    const Slot *const start = code.data();
+    const Value *const constants = program.constants.data();
+    const BytecodeFunction *const functions = program.functions.data();
+    Value *const stackEnd = stack.get() + StackSize;
+    Value *sp = stack.get();
+    Value *base = sp;
+    size_t depth = 0;
+    uint64_t count = 0;
+    const Slot *pc = start + functions[0].entry;
+
+    const BytecodeFunction &main = functions[0];
+    if (main.frameSize + main.maxStack > StackSize) {
+        throw RuntimeError("stack overflow");
+    }
+    frames[depth++] = CallFrame{nullptr, base};
+    for (uint32_t i = 0; i < main.frameSize; ++i) {
+        *sp++ = Value::null();
+    }
+
+    try {
+        DISPATCH();
+#if !MYN_THREADED
+    dispatch:
+        switch (static_cast<Opcode>((pc++)->operand)) {
+#endif
+
+        TARGET(Constant) {
+            *sp++ = constants[OPERAND()];
+            DISPATCH();
+        }
+        TARGET(Null) {
+            *sp++ = Value::null();
+            DISPATCH();
+        }
+        TARGET(True) {
+            *sp++ = Value::boolean(true);
+            DISPATCH();
+        }
+        TARGET(False) {
+            *sp++ = Value::boolean(false);
+            DISPATCH();
+        }
+        TARGET(LoadLocal) {
+            *sp++ = base[OPERAND()];
+            DISPATCH();
+        }
+        TARGET(StoreLocal) {
+            base[OPERAND()] = sp[-1];
+            DISPATCH();
+        }
+        TARGET(LoadGlobal) {
+            *sp++ = globals[OPERAND()];
+            DISPATCH();
+        }
+        TARGET(StoreGlobal) {
+            globals[OPERAND()] = sp[-1];
+            DISPATCH();
+        }
+        TARGET(Pop) {
+            --sp;
+            DISPATCH();
+        }
+        TARGET(Add) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            if (left.isInt() && right.isInt()) {
+                left = Value::integer(left.asInt() + right.asInt());
+            } else {
+                left = arithmetic(OpAdd, left, right, heap);
+                if (heap.due()) {
+                    collect(sp);
+                }
+            }
+            DISPATCH();
+        }
+        TARGET(Subtract) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            if (left.isInt() && right.isInt()) {
+                left = Value::integer(left.asInt() - right.asInt());
+            } else {
+                left = arithmetic(OpSubtract, left, right, heap);
+                if (heap.due()) {
+                    collect(sp);
+                }
+            }
+            DISPATCH();
+        }
+        TARGET(Multiply) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            if (left.isInt() && right.isInt()) {
+                left = intProduct(left, right);
+            } else {
+                left = arithmetic(OpMultiply, left, right, heap);
+                if (heap.due()) {
+                    collect(sp);
+                }
+            }
+            DISPATCH();
+        }
+        TARGET(Divide) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            if (left.isInt() && right.isInt()) {
+                left = intQuotient(left, right);
+            } else {
+                left = arithmetic(OpDivide, left, right, heap);
+                if (heap.due()) {
+                    collect(sp);
+                }
+            }
+            DISPATCH();
+        }
+        TARGET(Equal) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.raw() == right.raw() : equal(left, right));
+            DISPATCH();
+        }
+        TARGET(NotEqual) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.raw() != right.raw() : !equal(left, right));
+            DISPATCH();
+        }
+        TARGET(Less) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.asInt() < right.asInt()
+                                                                : compare(OpLess, left, right));
+            DISPATCH();
+        }
+        TARGET(Greater) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.asInt() > right.asInt()
+                                                                : compare(OpGreater, left, right));
+            DISPATCH();
+        }
+        TARGET(LessEqual) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.asInt() <= right.asInt()
+                                                                : compare(OpLessEqual, left, right));
+            DISPATCH();
+        }
+        TARGET(GreaterEqual) {
+            Value right = *--sp;
+            Value &left = sp[-1];
+            left = Value::boolean(left.isInt() && right.isInt() ? left.asInt() >= right.asInt()
+                                                                : compare(OpGreaterEqual, left, right));
+            DISPATCH();
+        }
+        // Operands of known types: no tags are looked at, and ints are never
+        // anywhere but in the value itself
+        TARGET(IntAdd) {
+            Value right = *--sp;
+            sp[-1] = Value::integer(sp[-1].asInt() + right.asInt());
+            DISPATCH();
+        }
+        TARGET(IntSubtract) {
+            Value right = *--sp;
+            sp[-1] = Value::integer(sp[-1].asInt() - right.asInt());
+            DISPATCH();
+        }
+        TARGET(IntMultiply) {
+            Value right = *--sp;
+            sp[-1] = intProduct(sp[-1], right);
+            DISPATCH();
+        }
+        TARGET(IntDivide) {
+            Value right = *--sp;
+            sp[-1] = intQuotient(sp[-1], right);
+            DISPATCH();
+        }
+        TARGET(IntEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].raw() == right.raw());
+            DISPATCH();
+        }
+        TARGET(IntNotEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].raw() != right.raw());
+            DISPATCH();
+        }
+        TARGET(IntLess) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asInt() < right.asInt());
+            DISPATCH();
+        }
+        TARGET(IntGreater) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asInt() > right.asInt());
+            DISPATCH();
+        }
+        TARGET(IntLessEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asInt() <= right.asInt());
+            DISPATCH();
+        }
+        TARGET(IntGreaterEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asInt() >= right.asInt());
+            DISPATCH();
+        }
+        TARGET(FloatAdd) {
+            Value right = *--sp;
+            sp[-1] = Value::number(sp[-1].asFloat() + right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatSubtract) {
+            Value right = *--sp;
+            sp[-1] = Value::number(sp[-1].asFloat() - right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatMultiply) {
+            Value right = *--sp;
+            sp[-1] = Value::number(sp[-1].asFloat() * right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatDivide) {
+            Value right = *--sp;
+            sp[-1] = Value::number(sp[-1].asFloat() / right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() == right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatNotEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() != right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatLess) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() < right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatGreater) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() > right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatLessEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() <= right.asFloat());
+            DISPATCH();
+        }
+        TARGET(FloatGreaterEqual) {
+            Value right = *--sp;
+            sp[-1] = Value::boolean(sp[-1].asFloat() >= right.asFloat());
+            DISPATCH();
+        }
+        TARGET(IntToFloat) {
+            sp[-1] = Value::number(static_cast<double>(sp[-1].asInt()));
+            DISPATCH();
+        }
+        TARGET(IntToFloatBelow) {
+            sp[-2] = Value::number(static_cast<double>(sp[-2].asInt()));
+            DISPATCH();
+        }
+        TARGET(Check) {
+            ValueType type = static_cast<ValueType>(OPERAND());
+            if (!conform(sp[-1], type)) {
+                conformError(type, sp[-1]);
+            }
+            DISPATCH();
+        }
+        TARGET(CheckLocal) {
+            Value &local = base[OPERAND()];
+            ValueType type = static_cast<ValueType>(OPERAND());
+            if (!conform(local, type)) {
+                conformError(type, local);
+            }
+            DISPATCH();
+        }
+        TARGET(ToBool) {
+            sp[-1] = Value::boolean(truthy(sp[-1]));
+            DISPATCH();
+        }
+        TARGET(Jump) {
+            pc = start + pc->operand;
+            DISPATCH();
+        }
+        TARGET(JumpIfFalse) {
+            uint32_t target = OPERAND();
+            if (isFalse(*--sp)) {
+                pc = start + target;
+            }
+            DISPATCH();
+        }
+        TARGET(JumpIfTrue) {
+            uint32_t target = OPERAND();
+            if (!isFalse(*--sp)) {
+                pc = start + target;
+            }
+            DISPATCH();
+        }
+        TARGET(Array) {
+            uint32_t size = OPERAND();
+            sp -= size;
+            *sp = heap.array(sp, size);
+            ++sp;
+            if (heap.due()) {
+                collect(sp);
+            }
+            DISPATCH();
+        }
+        TARGET(Call) {
+            const BytecodeFunction &function = functions[OPERAND()];
+            if (depth == MaxCallDepth ||
+                static_cast<size_t>(stackEnd - sp) < function.frameSize - function.arity + function.maxStack) {
+                throw RuntimeError("stack overflow");
+            }
+            // The arguments on the stack become the first locals
+            frames[depth++] = CallFrame{pc, base};
+            base = sp - function.arity;
+            for (uint32_t i = function.arity; i < function.frameSize; ++i) {
+                *sp++ = Value::null();
+            }
+            pc = start + function.entry;
+            DISPATCH();
+        }
+        TARGET(Return) {
+            Value result = sp[-1];
+            sp = base;
+            if (--depth == 0) {
+                goto finished;
+            }
+            pc = frames[depth].returnTo;
+            base = frames[depth].base;
+            *sp++ = result;
+            DISPATCH();
+        }
+        TARGET(Output) {
+            appendValue(output, *--sp);
+            output += '\n';
+            if (output.size() >= OutputChunk) {
+                flush();
+            }
+            DISPATCH();
+        }
+
+#if !MYN_THREADED
+        default:
+            break;
+        }
+#endif
+    } catch (const RuntimeError &error) {
+        // Every word of an instruction maps to its source offset, and pc is
+        // somewhere past the opcode of the one that failed
+        executed += count;
+        flush();
+        throw RuntimeError(error.what(), program.offsets[pc - 1 - start]);
+    }
+
+finished:
+    executed += count;
+    flush();
+
+#undef DISPATCH
+#undef TARGET
+#undef OPERAND
+}
@@ -0,0 +1,29 @@
+# Runs SOURCE through MYN with each set of FLAGS twice, once on an empty
+# cache and once after the source was cached under the default options, and
+# fails unless both runs print the same and exit the same way.
+# Usage: cmake -DMYN=<path to myn> -DSOURCE=<program.myn> -DCACHE=<scratch directory>
+#              -P cold_warm.cmake
+
+get_filename_component(directory "${SOURCE}" DIRECTORY)
+get_filename_component(name "${SOURCE}" NAME)
+
+foreach(flags "" "--max-nesting=2" "--max-nesting=0")
+    file(REMOVE_RECURSE "${CACHE}")
+    execute_process(COMMAND "${MYN}" --cache-dir=${CACHE} ${flags} --run "${name}"
+                    WORKING_DIRECTORY "${directory}"
+                    RESULT_VARIABLE cold_result OUTPUT_VARIABLE cold_output ERROR_VARIABLE cold_errors)
+
+    execute_process(COMMAND "${MYN}" --cache-dir=${CACHE} --run "${name}"
+                    WORKING_DIRECTORY "${directory}" OUTPUT_QUIET ERROR_QUIET)
+    execute_process(COMMAND "${MYN}" --cache-dir=${CACHE} ${flags} --run "${name}"
+                    WORKING_DIRECTORY "${directory}"
+                    RESULT_VARIABLE warm_result OUTPUT_VARIABLE warm_output ERROR_VARIABLE warm_errors)
+
+    if(NOT "${warm_output}" STREQUAL "${cold_output}" OR NOT "${warm_errors}" STREQUAL "${cold_errors}" OR
+       NOT "${warm_result}" STREQUAL "${cold_result}")
+        message(FATAL_ERROR "${name} behaves differently from the cache with '${flags}'\n"
+                            "cold (exit ${cold_result}):\n${cold_output}${cold_errors}\n"
+                            "warm (exit ${warm_result}):\n${warm_output}${warm_errors}")
+    endif()
+endforeach()
+file(REMOVE_RECURSE "${CACHE}")
@@ -0,0 +1,84 @@
+// Runs programs that make far more garbage than they keep, and fails unless
+// the heap stays small while everything still reachable survives.
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bytecode.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "vm.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(const char *name, const std::string &source, const std::string &expected, size_t maxObjects) {
+    SymbolTable symbols;
+    TokenBuffer tokens = tokenize(source, symbols);
+    Parser parser(tokens);
+    parser.parse();
+    Bytecode program;
+    Diagnostics errors;
+    compileProgram(parser.ast(), symbols, tokens.lineIndex(), program, errors);
+    if (!parser.diagnostics().empty() || !errors.empty()) {
+        std::cerr << name << ": does not compile" << std::endl;
+        ++failures;
+        return;
+    }
+
+    std::ostringstream out;
+    VM vm(program, out);
+    vm.run();
+    if (out.str() != expected) {
+        std::cerr << name << ": printed\n" << out.str() << "instead of\n" << expected;
+        ++failures;
+    }
+    if (vm.heapObjects() > maxObjects) {
+        std::cerr << name << ": " << vm.heapObjects() << " objects left on the heap, more than " << maxObjects
+                  << std::endl;
+        ++failures;
+    }
+}
+
+} // namespace
+
+int main() {
+    // Two million strings, one live at a time
+    check("strings",
+          "string s = '';\n"
+          "int i = 0;\n"
+          "while (i < 2000000) { s = 'value ' + i; i = i + 1; }\n"
+          "output(s);\n",
+          "value 1999999\n", 200000);
+
+    // Arrays that hold fresh strings, kept in locals of calls under way and
+    // in a global, while garbage piles up around them
+    check("arrays",
+          "fun build(int n, string tag) {\n"
+          "    if (n == 0) { return [tag + '!']; }\n"
+          "    string mine = tag + n;\n"
+          "    return [mine, build(n - 1, tag)];\n"
+          "}\n"
+          "string keep = 'start';\n"
+          "int i = 0;\n"
+          "while (i < 300000) {\n"
+          "    string junk = 'junk ' + i;\n"
+          "    if (i - i / 100000 * 100000 == 0) { keep = keep + '/' + i; }\n"
+          "    i = i + 1;\n"
+          "}\n"
+          "output(keep);\n"
+          "int j = 0;\n"
+          "while (j < 100000) { output(build(2, 'y' + j) == NULL); j = j + 1; }\n"
+          "output(build(3, 'x'));\n",
+          "start/0/100000/200000\n" + [] {
+              std::string lines;
+              for (int i = 0; i < 100000; ++i) {
+                  lines += "false\n";
+              }
+              return lines;
+          }() + "[x3, [x2, [x1, [x!]]]]\n",
+          200000);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,58 @@
+# Compiles the other sources in the directory of SOURCE into modules with MYN,
+# then runs SOURCE, which imports them, and fails unless it prints EXPECTED:
+# once right after the modules were written and checked, and once more with
+# the checks skipped. Works on a copy in SCRATCH.
+# Usage: cmake -DMYN=<path to myn> -DSOURCE=<program.myn> -DEXPECTED=<output> -DSCRATCH=<directory>
+#              -P import.cmake
+
+get_filename_component(directory "${SOURCE}" DIRECTORY)
+get_filename_component(name "${SOURCE}" NAME)
+file(REMOVE_RECURSE "${SCRATCH}")
+file(GLOB sources "${directory}/*.myn")
+file(COPY ${sources} DESTINATION "${SCRATCH}")
+
+foreach(module ${sources})
+    get_filename_component(module "${module}" NAME)
+    if(NOT module STREQUAL name)
+        execute_process(COMMAND "${MYN}" --cache-dir=cache --emit-module "${module}"
+                        WORKING_DIRECTORY "${SCRATCH}" RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE errors)
+        if(NOT result EQUAL 0 OR NOT errors STREQUAL "")
+            message(FATAL_ERROR "Could not compile ${module}:\n${errors}")
+        endif()
+    endif()
+endforeach()
+
+# Each module written was checked on the way and is trusted from then on
+file(GLOB modules "${SCRATCH}/*.mynm")
+file(GLOB marks "${SCRATCH}/cache/*.trust")
+list(LENGTH modules moduleCount)
+list(LENGTH marks markCount)
+if(markCount LESS moduleCount)
+    message(FATAL_ERROR "Only ${markCount} of ${moduleCount} modules are trusted after writing them")
+endif()
+
+foreach(run 1 2)
+    execute_process(COMMAND "${MYN}" --cache-dir=cache --run "${name}"
+                    WORKING_DIRECTORY "${SCRATCH}" RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+    if(NOT result EQUAL 0 OR NOT output STREQUAL "${EXPECTED}")
+        message(FATAL_ERROR "${name} went wrong on run ${run} (exit ${result}):\n${output}${errors}\n"
+                            "expected:\n${EXPECTED}")
+    endif()
+endforeach()
+
+# Without a cache nothing is trusted, and every module is checked again
+execute_process(COMMAND "${MYN}" --no-cache --run "${name}"
+                WORKING_DIRECTORY "${SCRATCH}" RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(NOT result EQUAL 0 OR NOT output STREQUAL "${EXPECTED}")
+    message(FATAL_ERROR "${name} went wrong without a cache (exit ${result}):\n${output}${errors}")
+endif()
+
+# A module that is not there is an error, even if nothing from it is used
+file(REMOVE_RECURSE "${SCRATCH}/cache")
+file(WRITE "${SCRATCH}/missing.myn" "import nowhere;\noutput(1);\n")
+execute_process(COMMAND "${MYN}" --no-cache --run missing.myn
+                WORKING_DIRECTORY "${SCRATCH}" RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(result EQUAL 0 OR NOT errors MATCHES "Cannot import nowhere")
+    message(FATAL_ERROR "Importing a missing module did not fail (exit ${result}):\n${output}${errors}")
+endif()
+file(REMOVE_RECURSE "${SCRATCH}")
@@ -0,0 +1,27 @@
+# Runs SOURCE with MYN at -O0 and at every higher level, and fails unless
+# each run prints the same output, errors included, and exits the same way.
+# Programs the compiler rejects must be rejected the same at every level.
+# Usage: cmake -DMYN=<path to myn> -DSOURCE=<program.myn> -P compare_levels.cmake
+
+get_filename_component(directory "${SOURCE}" DIRECTORY)
+get_filename_component(name "${SOURCE}" NAME)
+
+foreach(level 0 1 2)
+    execute_process(COMMAND "${MYN}" --no-cache -O${level} --run "${name}"
+                    WORKING_DIRECTORY "${directory}"
+                    RESULT_VARIABLE result${level}
+                    OUTPUT_VARIABLE output${level}
+                    ERROR_VARIABLE errors${level})
+endforeach()
+
+if("${output0}${errors0}" STREQUAL "")
+    message(FATAL_ERROR "${name} printed nothing at -O0")
+endif()
+foreach(level 1 2)
+    if(NOT "${output${level}}" STREQUAL "${output0}" OR NOT "${errors${level}}" STREQUAL "${errors0}" OR
+       NOT "${result${level}}" STREQUAL "${result0}")
+        message(FATAL_ERROR "${name} behaves differently at -O${level}\n"
+                            "-O0 (exit ${result0}):\n${output0}${errors0}\n"
+                            "-O${level} (exit ${result${level}}):\n${output${level}}${errors${level}}")
+    endif()
+endforeach()
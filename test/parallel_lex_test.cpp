@@ -0,0 +1,133 @@
+// Lexes large generated sources with tokenizeParallel() and fails unless the
+// tokens and atoms match tokenize() of the same source, token for token. Long
+// strings and comments are spliced in so that chunk targets fall inside them.
+// The scanner is picked once per process, so CTest runs this once for each
+// MYN_SIMD variant; a variant the machine lacks is reported as skipped.
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "corpus.hpp"
+#include "lexer.hpp"
+#include "scan.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+const int skipped = 77;
+const size_t threads = 4;
+const size_t minChunkSize = 256 * 1024; // As in parallel_lexer.cpp
+
+// Each is wrapped around a long run of filler, which holds what would open
+// one of the others so that a boundary search fooled by it shows up
+const char *const openers[] = {"'", "\"", "# ", "/* "};
+const char *const closers[] = {"'", "\"", "\n", " */"};
+const char *const fillers[] = {"quoted \" # /* x ", "quoted ' # */ y ", "line ' \" /* z ", "block ' \" # w\n"};
+
+std::string describe(const TokenBuffer &tokens, size_t i) {
+    if (i >= tokens.size()) {
+        return "nothing";
+    }
+    return "type " + std::to_string(static_cast<int>(tokens.type(i))) + " at " + std::to_string(tokens.offset(i)) +
+           " length " + std::to_string(tokens.length(i)) + " atom " + std::to_string(tokens.atom(i));
+}
+
+// Corpus text with a long string or comment put at the start of a line after
+// every stretch; the byte ranges of those are added to spans
+std::string generate(const char *shapeName, uint64_t seed, std::vector<std::pair<size_t, size_t>> &spans) {
+    CorpusShape shape;
+    findCorpusShape(shapeName, shape);
+    std::string corpus = generateCorpus(shape, 2 * 1024 * 1024, seed);
+    std::mt19937_64 random(seed);
+    std::string source;
+
+    size_t from = 0;
+    for (size_t kind = 0; from < corpus.size(); kind = (kind + 1) % 4) {
+        size_t stretch = corpus.find('\n', std::min(corpus.size(), from + 64 * 1024 + random() % (64 * 1024)));
+        stretch = stretch == std::string::npos ? corpus.size() : stretch + 1;
+        source.append(corpus, from, stretch - from);
+        from = stretch;
+
+        size_t start = source.size();
+        size_t length = 128 * 1024 + random() % (64 * 1024);
+        source += openers[kind];
+        while (source.size() - start < length) {
+            source += fillers[kind];
+        }
+        source += closers[kind];
+        source += kind == 2 ? "" : "\n";
+        spans.emplace_back(start, source.size());
+    }
+    return source;
+}
+
+// Whether any of the evenly spaced targets that tokenizeParallel() starts
+// its boundary search from lies inside a spliced string or comment
+bool targetInSpan(const std::string &source, const std::vector<std::pair<size_t, size_t>> &spans) {
+    size_t chunks = std::min(threads * 4, source.size() / minChunkSize);
+    for (size_t k = 1; k < chunks; ++k) {
+        size_t target = source.size() / chunks * k;
+        for (const auto &span : spans) {
+            if (span.first < target && target < span.second) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool run(const char *shapeName, uint64_t seed, ThreadPool &pool) {
+    std::vector<std::pair<size_t, size_t>> spans;
+    std::string source = generate(shapeName, seed, spans);
+    if (!targetInSpan(source, spans)) {
+        std::cerr << shapeName << " seed " << seed << ": no chunk target falls inside a string or comment"
+                  << std::endl;
+        return false;
+    }
+
+    SymbolTable parallelSymbols;
+    SymbolTable serialSymbols;
+    TokenBuffer parallel = tokenizeParallel(source, parallelSymbols, pool);
+    TokenBuffer serial = tokenize(source, serialSymbols);
+
+    size_t count = std::min(parallel.size(), serial.size());
+    for (size_t i = 0; i < count; ++i) {
+        if (parallel.type(i) != serial.type(i) || parallel.offset(i) != serial.offset(i) ||
+            parallel.length(i) != serial.length(i) || parallel.atom(i) != serial.atom(i)) {
+            std::cerr << shapeName << " seed " << seed << " with " << scanner().name << ": token " << i << " is "
+                      << describe(parallel, i) << " lexed in parallel but " << describe(serial, i) << " in one go"
+                      << std::endl;
+            return false;
+        }
+    }
+    if (parallel.size() != serial.size()) {
+        std::cerr << shapeName << " seed " << seed << " with " << scanner().name << ": " << parallel.size()
+                  << " tokens lexed in parallel but " << serial.size() << " in one go" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const char *forced = std::getenv("MYN_SIMD");
+    if (forced != nullptr && std::strcmp(forced, scanner().name) != 0) {
+        std::cout << "MYN_SIMD=" << forced << " is not available here, " << scanner().name << " was picked"
+                  << std::endl;
+        return skipped;
+    }
+
+    ThreadPool pool(threads);
+    bool passed = true;
+    for (const char *shape : {"mixed", "strings", "comments"}) {
+        for (uint64_t seed = 1; seed <= 2; ++seed) {
+            passed &= run(shape, seed, pool);
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+// Applies random edits to generated sources, patches the tokens with relex()
+// after each one and fails unless they match a fresh tokenize() of the
+// edited source, token for token.
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include "corpus.hpp"
+#include "lexer.hpp"
+
+namespace {
+
+// Pieces that open, close or split tokens, strings and comments
+const char *const fragments[] = {"x",  "name", "42",   "4.2", " ",   "\n",  "'",   "'text'", "/*", "*/", "/* c */",
+                                 "{",  "}",    "(",    ";",   "=",   "==",  "+",   "fun ",   "if", "while", "\"",
+                                 "\\", ".",    "0x1f", "\t",  "// ", "",    "é",   "[1, 2]"};
+
+std::string describe(const TokenBuffer &tokens, size_t i) {
+    if (i >= tokens.size()) {
+        return "nothing";
+    }
+    return "'" + std::string(tokens.value(i)) + "' type " + std::to_string(static_cast<int>(tokens.type(i))) +
+           " at " + std::to_string(tokens.offset(i)) + " atom " + std::to_string(tokens.atom(i));
+}
+
+// The index of the first token where the two differ, or tokens.size() if none
+size_t firstDifference(const TokenBuffer &patched, const TokenBuffer &fresh) {
+    size_t count = std::min(patched.size(), fresh.size());
+    for (size_t i = 0; i < count; ++i) {
+        if (patched.type(i) != fresh.type(i) || patched.offset(i) != fresh.offset(i) ||
+            patched.length(i) != fresh.length(i) || patched.atom(i) != fresh.atom(i)) {
+            return i;
+        }
+    }
+    return patched.size() == fresh.size() ? patched.size() : count;
+}
+
+bool run(const char *shapeName, uint64_t seed, size_t edits) {
+    CorpusShape shape;
+    findCorpusShape(shapeName, shape);
+    std::string source = generateCorpus(shape, 16 * 1024, seed);
+    std::mt19937_64 random(seed);
+    SymbolTable symbols;
+    TokenBuffer tokens = tokenize(source, symbols);
+
+    for (size_t step = 0; step < edits; ++step) {
+        // Edits land anywhere, the very start and end included
+        TextEdit edit;
+        edit.offset = random() % (source.size() + 1);
+        edit.removed = std::min<size_t>(random() % 3 == 0 ? random() % 40 : random() % 4, source.size() - edit.offset);
+        std::string inserted = fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))];
+        if (random() % 4 == 0) {
+            inserted += fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))];
+        }
+
+        std::string next = source.substr(0, edit.offset) + inserted + source.substr(edit.offset + edit.removed);
+        edit.inserted = std::string_view(next).substr(edit.offset, inserted.size());
+        relex(tokens, next, edit, symbols);
+        source.swap(next);
+        TokenBuffer fresh = tokenize(source, symbols);
+
+        size_t at = firstDifference(tokens, fresh);
+        if (at != tokens.size() || tokens.size() != fresh.size()) {
+            std::cerr << shapeName << " seed " << seed << ", edit " << step << " at " << edit.offset << " removing "
+                      << edit.removed << " and inserting '" << inserted << "': token " << at << " is "
+                      << describe(tokens, at) << " after relex but " << describe(fresh, at) << " lexed afresh"
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    bool passed = true;
+    for (const char *shape : {"mixed", "strings", "comments", "nesting", "identifiers"}) {
+        for (uint64_t seed = 1; seed <= 2; ++seed) {
+            passed &= run(shape, seed, 250);
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}